@@ -1,8 +1,13 @@
 #pragma once
 
+#include "grammar.hh"
+#include "memory.hh"
+
+#include <iterator>
 #include <ostream>
 #include <stack>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace cst {
@@ -10,12 +15,12 @@ namespace cst {
 class Node {
   public:
     Node(std::string type) :
-      type_(type) {
+      type_(std::move(type)) {
     }
     Node(std::string       type,
          std::vector<Node> children) :
-      type_(type),
-      children_(children) {
+      type_(std::move(type)),
+      children_(std::move(children)) {
     }
 
     auto getType() const -> std::string { return type_; }
@@ -27,6 +32,114 @@ class Node {
     std::vector<Node> children_;
 };
 
+// bytes held by a whole tree, sizeof(node) included
+static inline auto bytesOf(const Node &node) -> size_t {
+    size_t result = sizeof(Node);
+    auto   stack  = std::stack<const Node *>{{&node}};
+    while (!stack.empty()) {
+        auto top = stack.top();
+        stack.pop();
+        result += memory::heapOf(top->getType())
+                  + top->getChildren().capacity() * sizeof(Node);
+        for (auto &&child : top->getChildren()) {
+            stack.push(&child);
+        }
+    }
+    return result;
+}
+
+// parser sink building a Node tree
+class Builder {
+  public:
+    auto shift(Symbol symbol, size_t) -> void {
+        bytes_ += sizeof(Node) + memory::heapOf(symbol);
+        nodes_.push_back(Node{symbol.getName()});
+    }
+    auto reduce(const Rule &rule) -> void {
+        auto count = rule.getBody().size();
+        auto first = nodes_.end() - count;
+        auto node  = Node{rule.getHead().getName(),
+                         {std::make_move_iterator(first), std::make_move_iterator(nodes_.end())}};
+        bytes_ += (count + 1) * sizeof(Node) + memory::heapOf(rule.getHead());
+        nodes_.erase(first, nodes_.end());
+        nodes_.push_back(std::move(node));
+    }
+    // moves the tree out, so it can only be taken once
+    auto getResult() -> Node { return std::move(nodes_.back()); }
+    // running estimate of the bytes built so far, never decreases
+    auto getBytes() const -> size_t { return bytes_; }
+
+  private:
+    std::vector<Node> nodes_;
+    size_t            bytes_ = 0;
+};
+
+// parser sink building the tree shaped by the grammar's annotations, every
+// symbol on the parse stack owns zero or more of the nodes built so far
+class Projector {
+  public:
+    Projector(const Grammar &grammar) :
+      grammar_(grammar) {
+    }
+
+    auto shift(Symbol symbol, size_t) -> void {
+        auto annotation = grammar_.getAnnotation(symbol);
+        if (annotation.kind == Annotation::DROP) {
+            counts_.push_back(0);
+            return;
+        }
+        nodes_.push_back(Node{annotation.label.empty() ? symbol.getName() : annotation.label});
+        bytes_ += sizeof(Node) + memory::heapOf(nodes_.back().getType());
+        counts_.push_back(1);
+    }
+    auto reduce(const Rule &rule) -> void {
+        size_t count = 0;
+        for (size_t i = 0; i < rule.getBody().size(); i++) {
+            count += counts_.back();
+            counts_.pop_back();
+        }
+
+        auto annotation = grammar_.getAnnotation(rule);
+        auto first      = nodes_.end() - count;
+        switch (annotation.kind) {
+            case Annotation::INLINE: {
+                counts_.push_back(count);
+                break;
+            }
+            case Annotation::DROP: {
+                nodes_.erase(first, nodes_.end());
+                counts_.push_back(0);
+                break;
+            }
+            case Annotation::KEEP: {
+                auto node = Node{annotation.label.empty() ? rule.getHead().getName() : annotation.label,
+                                 {std::make_move_iterator(first), std::make_move_iterator(nodes_.end())}};
+                bytes_ += (count + 1) * sizeof(Node) + memory::heapOf(node.getType());
+                nodes_.erase(first, nodes_.end());
+                nodes_.push_back(std::move(node));
+                counts_.push_back(1);
+                break;
+            }
+        }
+    }
+    // an inlined or dropped root leaves an untyped node holding what is
+    // left, moved out as in Builder::getResult
+    auto getResult() -> Node {
+        if (nodes_.size() == 1) {
+            return std::move(nodes_.back());
+        }
+        return Node{"", std::move(nodes_)};
+    }
+    // as Builder::getBytes
+    auto getBytes() const -> size_t { return bytes_; }
+
+  private:
+    const Grammar      &grammar_;
+    std::vector<Node>   nodes_;
+    std::vector<size_t> counts_;
+    size_t              bytes_ = 0;
+};
+
 static inline auto operator<<(std::ostream &os, const Node &node) -> std::ostream & {
     struct data {
         int         depth;
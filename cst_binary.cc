@@ -0,0 +1,212 @@
+#include "cst_binary.hh"
+#include "grammar.hh"
+#include "memory.hh"
+
+#include <cstring>
+#include <fcntl.h>
+#include <numeric>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+namespace cst {
+
+static constexpr char     magic[4] = {'C', 'S', 'T', 'B'};
+static constexpr uint32_t version  = 2;
+
+Writer::Writer(std::ostream &os) :
+  os_(os),
+  start_(os.tellp()) {
+    // placeholder, patched by finish()
+    auto header = Header{};
+    os_.write(reinterpret_cast<const char *>(&header), sizeof(header));
+}
+
+auto Writer::shift(Symbol symbol, size_t position) -> void {
+    // ε leaves cover no token
+    auto begin = static_cast<uint64_t>(position);
+    auto end   = symbol.isEpsilon() ? begin : begin + 1;
+    write(Record{getSymbolId(symbol), 0, 1, begin, end});
+    stack_.push_back(data{1, begin, end});
+    position_ = end;
+}
+
+auto Writer::reduce(const Rule &rule) -> void {
+    auto count = static_cast<uint32_t>(rule.getBody().size());
+    auto first = stack_.end() - count;
+    auto node  = data{1, position_, position_};
+    if (count > 0) {
+        node.begin = first->begin;
+        node.end   = stack_.back().end;
+        node.size  = std::accumulate(first, stack_.end(), uint64_t{1}, [](uint64_t x, const data &y) {
+            return x + y.size;
+        });
+    }
+    stack_.erase(first, stack_.end());
+    stack_.push_back(node);
+    write(Record{getSymbolId(rule.getHead()), count, node.size, node.begin, node.end});
+}
+
+auto Writer::finish() -> void {
+    auto symbolOffset = static_cast<uint64_t>(os_.tellp() - start_);
+    auto count        = static_cast<uint32_t>(symbols_.size());
+    os_.write(reinterpret_cast<const char *>(&count), sizeof(count));
+    for (auto &&name : symbols_) {
+        auto length = static_cast<uint32_t>(name.size());
+        os_.write(reinterpret_cast<const char *>(&length), sizeof(length));
+        os_.write(name.data(), length);
+    }
+
+    auto end    = os_.tellp();
+    auto header = Header{{}, version, nodeCount_, symbolOffset};
+    std::memcpy(header.magic, magic, sizeof(magic));
+    os_.seekp(start_);
+    os_.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    os_.seekp(end);
+}
+
+auto Writer::getBytes() const -> size_t {
+    size_t result = stack_.capacity() * sizeof(data)
+                    + symbols_.capacity() * sizeof(std::string);
+    for (auto &&name : symbols_) {
+        result += memory::mapNode<std::pair<const std::string, uint32_t>>
+                  + memory::heapOf(name) * 2;
+    }
+    return result;
+}
+
+auto Writer::getSymbolId(Symbol symbol) -> uint32_t {
+    auto [it, inserted] = symbolMap_.emplace(symbol.getName(), symbols_.size());
+    if (inserted) {
+        symbols_.push_back(symbol.getName());
+    }
+    return it->second;
+}
+
+auto Writer::write(Record record) -> void {
+    os_.write(reinterpret_cast<const char *>(&record), sizeof(record));
+    nodeCount_++;
+}
+
+auto View::getType() const -> std::string_view {
+    return reader_->getSymbol(record_->symbol);
+}
+
+auto View::getChildren() const -> std::vector<View> {
+    // last child first, each one skips its whole subtree
+    auto result = std::vector<View>(getChildCount(), *this);
+    auto cur    = record_ - 1;
+    for (size_t i = getChildCount(); i > 0; i--) {
+        result[i - 1] = View{*reader_, cur};
+        cur -= cur->size;
+    }
+    return result;
+}
+
+auto Reader::open(const std::string &path) -> std::optional<Reader> {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return {};
+    }
+    struct stat st {};
+    if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(Header)) {
+        ::close(fd);
+        return {};
+    }
+    auto length = static_cast<size_t>(st.st_size);
+    auto addr   = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        return {};
+    }
+
+    auto data   = static_cast<const char *>(addr);
+    auto header = reinterpret_cast<const Header *>(data);
+    auto fail   = [addr, length]() -> std::optional<Reader> {
+        munmap(addr, length);
+        return {};
+    };
+    if (std::memcmp(header->magic, magic, sizeof(magic)) != 0
+        || header->version != version
+        || header->nodeCount == 0
+        || header->nodeCount > (length - sizeof(Header)) / sizeof(Record)
+        || header->symbolOffset != sizeof(Header) + header->nodeCount * sizeof(Record)
+        || header->symbolOffset + sizeof(uint32_t) > length) {
+        return fail();
+    }
+
+    // symbol names stay in the mapping, only their views are collected
+    auto symbols = std::vector<std::string_view>{};
+    auto offset  = header->symbolOffset;
+
+    uint32_t count;
+    std::memcpy(&count, data + offset, sizeof(count));
+    offset += sizeof(count);
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t size;
+        if (offset + sizeof(size) > length) {
+            return fail();
+        }
+        std::memcpy(&size, data + offset, sizeof(size));
+        offset += sizeof(size);
+        if (offset + size > length) {
+            return fail();
+        }
+        symbols.emplace_back(data + offset, size);
+        offset += size;
+    }
+
+    // replays the postorder the writer emitted: each record closes the
+    // last childCount open subtrees, which must add up to its size, and
+    // only the root may be left open at the end
+    auto records = reinterpret_cast<const Record *>(data + sizeof(Header));
+    auto pending = std::vector<uint64_t>{};
+    for (uint64_t i = 0; i < header->nodeCount; i++) {
+        auto &&record = records[i];
+        if (record.symbol >= count
+            || record.childCount > pending.size()
+            || record.begin > record.end) {
+            return fail();
+        }
+        uint64_t size = 1;
+        for (auto it = pending.end() - record.childCount; it != pending.end(); it++) {
+            size += *it;
+        }
+        if (record.size != size) {
+            return fail();
+        }
+        pending.resize(pending.size() - record.childCount);
+        pending.push_back(size);
+    }
+    if (pending.size() != 1) {
+        return fail();
+    }
+    return Reader{data, length, std::move(symbols)};
+}
+
+Reader::Reader(const char                     *data,
+               size_t                          length,
+               std::vector<std::string_view> &&symbols) :
+  data_(data),
+  length_(length),
+  records_(reinterpret_cast<const Record *>(data + sizeof(Header))),
+  nodeCount_(reinterpret_cast<const Header *>(data)->nodeCount),
+  symbols_(std::move(symbols)) {
+}
+
+Reader::Reader(Reader &&other) :
+  data_(std::exchange(other.data_, nullptr)),
+  length_(other.length_),
+  records_(other.records_),
+  nodeCount_(other.nodeCount_),
+  symbols_(std::move(other.symbols_)) {
+}
+
+Reader::~Reader() {
+    if (data_ != nullptr) {
+        munmap(const_cast<char *>(data_), length_);
+    }
+}
+
+}; // namespace cst
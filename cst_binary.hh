@@ -0,0 +1,148 @@
+#pragma once
+
+#include "grammar.hh"
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <ostream>
+#include <stack>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Compact binary CST format
+ * * Header, then one Record per node, then the symbol table
+ * * records are written in postorder, the order an LR parser reduces in, so
+ *   the root is the last record and a node's last child sits right before it
+ * * each record stores its subtree size, the previous sibling of a node is
+ *   found by skipping that many records backwards
+ * * sizes and spans are 64 bit like the node count, so any tree the header
+ *   can count can be written
+ */
+namespace cst {
+
+struct Header {
+    char     magic[4];
+    uint32_t version;
+    uint64_t nodeCount;
+    uint64_t symbolOffset;
+};
+
+struct Record {
+    uint32_t symbol;
+    uint32_t childCount;
+    uint64_t size;  // records in this subtree, itself included
+    uint64_t begin; // first token of the span
+    uint64_t end;   // one past the last token
+};
+
+static_assert(sizeof(Header) == 24);
+static_assert(sizeof(Record) == 32);
+
+// parser sink streaming records to `os`, finish() must be called once the
+// parse returned
+class Writer {
+  public:
+    Writer(std::ostream &os);
+
+    auto shift(Symbol symbol, size_t position) -> void;
+    auto reduce(const Rule &rule) -> void;
+    auto finish() -> void;
+    // records are not kept, only the open subtrees and the symbol names
+    auto getBytes() const -> size_t;
+
+  private:
+    struct data {
+        uint64_t size;
+        uint64_t begin;
+        uint64_t end;
+    };
+
+    auto getSymbolId(Symbol symbol) -> uint32_t;
+    auto write(Record record) -> void;
+
+    std::ostream                   &os_;
+    std::streampos                  start_;
+    uint64_t                        nodeCount_ = 0;
+    uint64_t                        position_  = 0;
+    std::vector<data>               stack_;
+    std::map<std::string, uint32_t> symbolMap_;
+    std::vector<std::string>        symbols_;
+};
+
+class Reader;
+
+// a node inside a mapped file, cheap to copy
+class View {
+  public:
+    View(const Reader &reader, const Record *record) :
+      reader_(&reader),
+      record_(record) {
+    }
+
+    auto getType() const -> std::string_view;
+    auto getChildCount() const -> size_t { return record_->childCount; }
+    auto getChildren() const -> std::vector<View>;
+    auto getBegin() const -> size_t { return record_->begin; }
+    auto getEnd() const -> size_t { return record_->end; }
+
+  private:
+    const Reader *reader_;
+    const Record *record_;
+};
+
+// maps a file written by Writer, nodes are read in place
+class Reader {
+  public:
+    // checks every record once, so a corrupted or truncated file is
+    // rejected here instead of read out of bounds by View
+    static auto open(const std::string &path) -> std::optional<Reader>;
+
+    Reader(const Reader &) = delete;
+    Reader(Reader &&other);
+    ~Reader();
+
+    auto getRoot() const -> View { return {*this, records_ + nodeCount_ - 1}; }
+    auto getNodeCount() const -> size_t { return nodeCount_; }
+    auto getSymbol(uint32_t id) const -> std::string_view { return symbols_.at(id); }
+
+  private:
+    Reader(const char                     *data,
+           size_t                          length,
+           std::vector<std::string_view> &&symbols);
+
+    const char                   *data_;
+    size_t                        length_;
+    const Record                 *records_;
+    size_t                        nodeCount_;
+    std::vector<std::string_view> symbols_;
+};
+
+static inline auto operator<<(std::ostream &os, const View &view) -> std::ostream & {
+    struct data {
+        int               depth;
+        size_t            nth;
+        std::vector<View> children;
+        View              cur;
+    };
+    auto stack = std::stack<data>{{data{0, 0, view.getChildren(), view}}};
+    while (!stack.empty()) {
+        auto &top = stack.top();
+        if (top.nth == 0) {
+            os << std::string(top.depth, ' ')
+               << top.cur.getType()
+               << std::endl;
+        }
+        if (top.nth < top.children.size()) {
+            auto child = top.children.at(top.nth++);
+            stack.push(data{top.depth + 2, 0, child.getChildren(), child});
+        } else {
+            stack.pop();
+        }
+    }
+    return os;
+}
+
+}; // namespace cst
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "grammar.hh"
+#include "memory.hh"
+
+#include <cstddef>
+#include <ostream>
+#include <set>
+#include <variant>
+#include <vector>
+
+// an input token no parse could continue with, `found` is $ when the input
+// ran out
+struct SyntaxError {
+    size_t           position;
+    Symbol           found;
+    std::set<Symbol> expected;
+};
+
+static inline auto operator<<(std::ostream &os, const SyntaxError &error) -> std::ostream & {
+    os << error.position
+       << ": unexpected "
+       << error.found
+       << ", expected "
+       << error.expected
+       << std::endl;
+    return os;
+}
+
+// more than one rule predicted for (head, lookAhead), a parser that would
+// have to guess between them refuses to run
+struct ConflictError {
+    Symbol            head;
+    Symbol            lookAhead;
+    std::vector<Rule> rules;
+};
+
+static inline auto operator<<(std::ostream &os, const ConflictError &error) -> std::ostream & {
+    os << "conflict on "
+       << error.head
+       << ", "
+       << error.lookAhead
+       << ": ";
+    for (size_t i = 0; i < error.rules.size(); i++) {
+        os << (i == 0 ? "" : ", ") << error.rules[i].to_string();
+    }
+    os << std::endl;
+    return os;
+}
+
+// `symbol` derives no terminal string, nothing can be generated from it
+struct UnproductiveError {
+    Symbol symbol;
+};
+
+static inline auto operator<<(std::ostream &os, const UnproductiveError &error) -> std::ostream & {
+    os << "unproductive "
+       << error.symbol
+       << std::endl;
+    return os;
+}
+
+using ParseError = std::variant<SyntaxError, memory::OverBudget, ConflictError>;
+
+static inline auto operator<<(std::ostream &os, const ParseError &error) -> std::ostream & {
+    std::visit([&os](auto &&x) { os << x; }, error);
+    return os;
+}
@@ -0,0 +1,69 @@
+#include "generator.hh"
+#include "grammar.hh"
+
+#include <algorithm>
+#include <cassert>
+#include <random>
+
+auto Generator::solve() -> void {
+    auto &&rules = grammar.getRules();
+    for (size_t i = 0; i < rules.size(); i++) {
+        rulesMap[rules[i].getHead()].push_back(i);
+    }
+    for (auto &&symbol : grammar.getSymbols()) {
+        heightMap.emplace(symbol, symbol.isTerminal() ? 0 : infinity);
+    }
+
+    bool changed;
+    do {
+        changed = false;
+        for (auto &&rule : rules) {
+            size_t height = 0;
+            for (auto &&symbol : rule.getBody()) {
+                height = std::max(height, heightMap.at(symbol));
+            }
+            if (height != infinity && height + 1 < heightMap.at(rule.getHead())) {
+                heightMap.at(rule.getHead()) = height + 1;
+                changed = true;
+            }
+        }
+    } while (changed);
+}
+
+auto Generator::mk(const Grammar &grammar, uint64_t seed) -> std::expected<Generator, UnproductiveError> {
+    auto generator = Generator{grammar, seed};
+    // every rule chosen from here on has a productive body, so choose()
+    // always finds a candidate
+    if (generator.heightMap.at(grammar.getStartSymbol()) == infinity) {
+        return std::unexpected(UnproductiveError{grammar.getStartSymbol()});
+    }
+    return generator;
+}
+
+auto Generator::choose(Symbol head, bool terminate) -> const Rule & {
+    auto &&rules = grammar.getRules();
+    auto   heightOf = [this, &rules](size_t i) {
+        size_t height = 0;
+        for (auto &&symbol : rules[i].getBody()) {
+            height = std::max(height, heightMap.at(symbol));
+        }
+        return height;
+    };
+
+    // productive rules only, and only the shortest ones once out of depth
+    auto candidates = std::vector<size_t>{};
+    for (auto &&i : rulesMap.at(head)) {
+        auto height = heightOf(i);
+        if (height == infinity) {
+            continue;
+        }
+        if (terminate && height + 1 != heightMap.at(head)) {
+            continue;
+        }
+        candidates.push_back(i);
+    }
+    assert(!candidates.empty());
+
+    auto dist = std::uniform_int_distribution<size_t>{0, candidates.size() - 1};
+    return rules[candidates[dist(engine)]];
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "error.hh"
+#include "grammar.hh"
+#include "utils.hh"
+
+#include <concepts>
+#include <cstdint>
+#include <expected>
+#include <limits>
+#include <map>
+#include <ostream>
+#include <random>
+#include <stack>
+#include <vector>
+
+/**
+ * Random sentence generator for load-testing parsers
+ * * sentence(depth, emit): emits one valid token stream ending with $
+ * * stream(length, depth, emit): emits sentences until length tokens are out
+ * Tokens are handed to `emit` one at a time, nothing is buffered.
+ */
+class Generator {
+  public:
+    // fails when the start symbol derives no terminal string
+    static auto mk(const Grammar &grammar, uint64_t seed) -> std::expected<Generator, UnproductiveError>;
+
+    template <typename FuncT>
+    auto sentence(size_t depth, FuncT &&emit) -> size_t {
+        struct data {
+            Symbol symbol;
+            size_t depth;
+        };
+        size_t count = 0;
+        auto   stack = std::stack<data>{{data{grammar.getStartSymbol(), 0}}};
+        while (!stack.empty()) {
+            auto top = stack.top();
+            stack.pop();
+
+            if (top.symbol.isEpsilon()) {
+                continue;
+            } else if (top.symbol.isTerminal()) {
+                emit(top.symbol);
+                count++;
+                continue;
+            }
+            if (top.depth >= depth && nSolver.nullable(top.symbol)) {
+                // derives ε, nothing to emit
+                continue;
+            }
+
+            auto &&body = choose(top.symbol, top.depth >= depth).getBody();
+            for (auto it = body.rbegin(); it != body.rend(); it++) {
+                stack.push(data{*it, top.depth + 1});
+            }
+        }
+        emit("$"_sym);
+        return count + 1;
+    }
+
+    template <typename FuncT>
+        requires std::invocable<FuncT &, Symbol>
+    auto stream(size_t length, size_t depth, FuncT &&emit) -> size_t {
+        size_t count = 0;
+        while (count < length) {
+            count += sentence(depth, emit);
+        }
+        return count;
+    }
+
+    auto stream(size_t length, size_t depth, std::ostream &os) -> size_t {
+        return stream(length, depth, [&os](Symbol symbol) {
+            os << symbol << (symbol == "$"_sym ? '\n' : ' ');
+        });
+    }
+
+  private:
+    Generator(const Grammar &_grammar, uint64_t seed) :
+      grammar(_grammar),
+      nSolver(_grammar),
+      engine(seed) {
+        solve();
+    }
+
+    auto solve() -> void;
+    auto choose(Symbol head, bool terminate) -> const Rule &;
+
+    static constexpr size_t infinity = std::numeric_limits<size_t>::max();
+
+    // minimal derivation height of each symbol, infinity if unproductive
+    std::map<Symbol, size_t>              heightMap;
+    std::map<Symbol, std::vector<size_t>> rulesMap;
+    const Grammar                        &grammar;
+    Nullable                              nSolver;
+    std::mt19937_64                       engine;
+};
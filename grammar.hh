@@ -1,6 +1,8 @@
 #pragma once
 
+#include <algorithm>
 #include <initializer_list>
+#include <map>
 #include <numeric>
 #include <ostream>
 #include <ranges>
@@ -8,11 +10,18 @@
 #include <string>
 #include <vector>
 
+// folds value into seed, order dependent. a product would be 0 as soon as
+// one factor is, std::hash<bool>{}(false) for one
+static inline auto hashCombine(size_t seed, size_t value) -> size_t {
+    return seed ^ (value + 0x9e3779b97f4a7c15 + (seed << 6) + (seed >> 2));
+}
+
 struct Symbol {
     struct hash {
         auto operator()(const Symbol &symbol) const -> size_t {
-            return std::hash<std::string>{}(symbol.getName())
-                   * std::hash<bool>{}(symbol.isTerminal());
+            // terminals and nonterminals of the same name hash apart
+            return hashCombine(symbol.isTerminal() ? 0x5bd1e995 : 0x27d4eb2f,
+                               std::hash<std::string>{}(symbol.getName()));
         }
     };
 
@@ -39,14 +48,11 @@ struct Symbol {
 struct Rule {
     struct hash {
         auto operator()(const Rule &rule) const -> size_t {
-            return std::transform_reduce(
-                rule.getBody().cbegin(),
-                rule.getBody().cend(),
-                Symbol::hash{}(rule.getHead()),
-                [](auto &&x, auto &&y) {
-                    return x * y;
-                },
-                Symbol::hash{});
+            size_t result = Symbol::hash{}(rule.getHead());
+            for (auto &&symbol : rule.getBody()) {
+                result = hashCombine(result, Symbol::hash{}(symbol));
+            }
+            return result;
         }
     };
 
@@ -91,16 +97,52 @@ struct Rule {
 
 static inline auto operator""_sym(const char *str, size_t len) -> Symbol;
 
+// how a symbol or rule shows up in the tree built by the parser
+struct Annotation {
+    enum AnnotationKind {
+        KEEP,   // a node, labelled `label` if not empty
+        DROP,   // no node at all
+        INLINE, // children are spliced into the parent
+    };
+
+    static auto mkKeep() -> Annotation { return {KEEP, {}}; }
+    static auto mkLabel(std::string label) -> Annotation { return {KEEP, label}; }
+    static auto mkDrop() -> Annotation { return {DROP, {}}; }
+    static auto mkInline() -> Annotation { return {INLINE, {}}; }
+
+    auto operator<=>(const Annotation &) const = default;
+
+    enum AnnotationKind kind;
+    std::string         label;
+};
+
 struct Grammar {
     template <typename... T>
     static auto mk(Symbol start, T... rules) -> Grammar {
-        return {start, {rules...}};
+        return {{start}, {rules...}};
+    }
+    // several entry points, each start symbol gets its own start state in
+    // the same automaton, the first one is the default
+    template <typename... T>
+    static auto mk(std::initializer_list<Symbol> starts, T... rules) -> Grammar {
+        return {starts, {rules...}};
     }
 
-    auto getStartSymbol() const -> Symbol { return start_; }
-    auto getStartRule() const -> Rule { return getRulesWith(getStartSymbol()).at(0); }
+    auto getStartSymbol() const -> Symbol { return starts_.at(0); }
+    auto getStartSymbols() const -> const std::vector<Symbol> & { return starts_; }
+    // the parsers accept on <S>'->S for an entry S, the rule is not part of
+    // the grammar so S may have any number of rules and appear in bodies
+    static auto getEntryRule(Symbol start) -> Rule {
+        return Rule::mk(Symbol::mkNTerm("<" + start.getName() + ">'")).of(start);
+    }
+    auto isEntryRule(const Rule &rule) const -> bool {
+        return std::ranges::any_of(starts_, [&rule](Symbol start) {
+            return getEntryRule(start) == rule;
+        });
+    }
     auto getSymbols() const -> std::set<Symbol> {
-        auto result = std::set<Symbol>{getStartSymbol(), "$"_sym};
+        auto result = std::set<Symbol>{starts_.begin(), starts_.end()};
+        result.emplace("$"_sym);
         for (auto &&rule : getRules()) {
             result.emplace(rule.getHead());
             for (auto &&symbol : rule.getBody()) {
@@ -123,21 +165,39 @@ struct Grammar {
     }
     auto getRules() const -> const std::vector<Rule> & { return rules_; }
     auto getRules() -> std::vector<Rule> & { return rules_; }
+    auto hasAnnotations() const -> bool { return !symbolAnnotations_.empty() || !ruleAnnotations_.empty(); }
+    auto setAnnotation(Symbol symbol, Annotation annotation) -> void { symbolAnnotations_[symbol] = annotation; }
+    auto setAnnotation(Rule rule, Annotation annotation) -> void { ruleAnnotations_[rule] = annotation; }
+    auto getAnnotation(Symbol symbol) const -> Annotation {
+        if (symbolAnnotations_.contains(symbol)) {
+            return symbolAnnotations_.at(symbol);
+        }
+        return Annotation::mkKeep();
+    }
+    // a rule's own annotation wins over the one of its head
+    auto getAnnotation(const Rule &rule) const -> Annotation {
+        if (ruleAnnotations_.contains(rule)) {
+            return ruleAnnotations_.at(rule);
+        }
+        return getAnnotation(rule.getHead());
+    }
     auto getRulesWith(Symbol head) const -> std::vector<Rule> {
         auto view = getRules()
-                    | std::views::filter([head](Rule rule) {
+                    | std::views::filter([head](const Rule &rule) {
                           return rule.getHead() == head;
                       });
         return {view.begin(), view.end()};
     }
 
   private:
-    Grammar(Symbol start, std::initializer_list<Rule> rules) :
-      start_(start),
+    Grammar(std::initializer_list<Symbol> starts, std::initializer_list<Rule> rules) :
+      starts_(starts),
       rules_(rules) {
     }
-    Symbol            start_;
-    std::vector<Rule> rules_;
+    std::vector<Symbol>          starts_;
+    std::vector<Rule>            rules_;
+    std::map<Symbol, Annotation> symbolAnnotations_;
+    std::map<Rule, Annotation>   ruleAnnotations_;
 };
 
 static inline auto operator""_sym(const char *str, size_t len) -> Symbol {
@@ -0,0 +1,54 @@
+#include "ll1.hh"
+#include "grammar.hh"
+#include "utils.hh"
+
+#include <map>
+#include <ranges>
+#include <set>
+
+LL1Parser::LL1Parser(const Grammar &grammar) :
+  grammar_(grammar) {
+    auto fSolver  = First{grammar};
+    auto nSolver  = Nullable{grammar};
+    auto flSolver = Follow{grammar};
+
+    // PREDICT(A->α) = FIRST(α), plus FOLLOW(A) if α is nullable
+    auto candidates = std::map<std::pair<Symbol, Symbol>, std::vector<size_t>>{};
+    auto &&rules    = grammar.getRules();
+    for (size_t i = 0; i < rules.size(); i++) {
+        auto &&head = rules[i].getHead();
+        auto &&body = rules[i].getBody();
+
+        auto predict = body.empty() ? std::set<Symbol>{} : fSolver.getFirst(body);
+        if (nSolver.nullable(body)) {
+            auto follow = flSolver.getFollow(head);
+            predict.insert(follow.begin(), follow.end());
+        }
+        for (auto &&lookAhead : predict) {
+            if (!lookAhead.isEpsilon()) {
+                candidates[{head, lookAhead}].push_back(i);
+            }
+        }
+    }
+
+    for (auto &&[key, indices] : candidates) {
+        predictMap_.emplace(key, indices.front());
+        if (indices.size() > 1) {
+            auto conflict = Conflict{key.first, key.second, {}};
+            for (auto &&i : indices) {
+                conflict.rules.push_back(rules[i]);
+            }
+            conflicts_.push_back(conflict);
+        }
+    }
+}
+
+auto LL1Parser::getExpected(Symbol head) const -> std::set<Symbol> {
+    auto result = std::set<Symbol>{};
+    for (auto &&key : predictMap_ | std::views::keys) {
+        if (key.first == head) {
+            result.insert(key.second);
+        }
+    }
+    return result;
+}
@@ -0,0 +1,166 @@
+#pragma once
+
+#include "cst.hh"
+#include "error.hh"
+#include "grammar.hh"
+#include "memory.hh"
+#include "utils.hh"
+
+#include <expected>
+#include <map>
+#include <optional>
+#include <set>
+#include <stack>
+#include <utility>
+#include <variant>
+#include <vector>
+
+class LL1Parser {
+  public:
+    // the first listed rule is the one kept in the table, parse and recover
+    // report the first conflict instead of running on such a table
+    using Conflict = ConflictError;
+
+    LL1Parser(const Grammar &grammar);
+
+    auto isLL1() const -> bool { return conflicts_.empty(); }
+    auto getConflicts() const -> const std::vector<Conflict> & { return conflicts_; }
+    // bytes of stack and tree a parse may use, 0 for no limit
+    auto setParseBudget(size_t budget) -> void { parseBudget_ = budget; }
+    auto getPredict(Symbol head, Symbol lookAhead) const -> std::optional<Rule> {
+        if (predictMap_.contains({head, lookAhead})) {
+            return grammar_.getRules().at(predictMap_.at({head, lookAhead}));
+        }
+        return {};
+    }
+
+    template <typename RangeT>
+    auto parse(const RangeT &input) const -> std::expected<cst::Node, ParseError> {
+        return parse(input, grammar_.getStartSymbol());
+    }
+
+    template <typename RangeT>
+    auto parse(const RangeT &input, Symbol entry) const -> std::expected<cst::Node, ParseError> {
+        if (grammar_.hasAnnotations()) {
+            auto projector = cst::Projector{grammar_};
+            if (auto result = parse(input, entry, projector); !result.has_value()) {
+                return std::unexpected(std::move(result.error()));
+            }
+            return projector.getResult();
+        }
+        auto builder = cst::Builder{};
+        if (auto result = parse(input, entry, builder); !result.has_value()) {
+            return std::unexpected(std::move(result.error()));
+        }
+        return builder.getResult();
+    }
+
+    // same events as LR1Parser::parse, a reduce is emitted once the whole
+    // body has been matched, the last one is for a rule of the entry
+    template <typename RangeT, typename SinkT>
+    auto parse(const RangeT &input, Symbol entry, SinkT &sink) const -> std::expected<void, ParseError> {
+        auto error = std::optional<ParseError>{};
+        drive(input, entry, sink, [&error](ParseError &&e) {
+            error = std::move(e);
+            return false;
+        });
+        if (error.has_value()) {
+            return std::unexpected(std::move(error.value()));
+        }
+        return {};
+    }
+
+    // panic mode as in LR1Parser::recover
+    template <typename RangeT, typename SinkT>
+    auto recover(const RangeT &input, Symbol entry, SinkT &sink) const -> std::vector<ParseError> {
+        auto errors = std::vector<ParseError>{};
+        drive(input, entry, sink, [&errors](ParseError &&e) {
+            errors.push_back(std::move(e));
+            return true;
+        });
+        return errors;
+    }
+
+  private:
+    auto getExpected(Symbol head) const -> std::set<Symbol>;
+
+    // `onError` returns whether to skip the offending token and go on
+    template <typename RangeT, typename SinkT, typename FuncT>
+    auto drive(const RangeT &input, Symbol entry, SinkT &sink, FuncT &&onError) const -> void {
+        using data = std::variant<Symbol, const Rule *>;
+
+        if (!isLL1()) {
+            onError(conflicts_.front());
+            return;
+        }
+        size_t position = 0;
+        auto   stack    = std::stack<data>{{data{entry}}};
+        auto   it       = input.begin();
+        auto   skip     = [&](std::set<Symbol> expected) {
+            auto found = it == input.end() ? "$"_sym : *it;
+            if (!onError(SyntaxError{position, found, std::move(expected)}) || found == "$"_sym) {
+                return false;
+            }
+            position++;
+            it++;
+            return true;
+        };
+        while (!stack.empty()) {
+            if (parseBudget_ != 0) {
+                auto used = stack.size() * sizeof(data) + memory::sinkBytes(sink);
+                if (used > parseBudget_) {
+                    onError(memory::OverBudget{parseBudget_, used});
+                    return;
+                }
+            }
+            auto top = stack.top();
+
+            if (auto rule = std::get_if<const Rule *>(&top)) {
+                stack.pop();
+                sink.reduce(**rule);
+                continue;
+            }
+            auto symbol = std::get<Symbol>(top);
+            if (symbol.isEpsilon()) {
+                stack.pop();
+                sink.shift(symbol, position);
+            } else if (symbol.isTerminal()) {
+                if (it == input.end() || *it != symbol) {
+                    if (!skip({symbol})) {
+                        return;
+                    }
+                    continue;
+                }
+                stack.pop();
+                sink.shift(symbol, position++);
+                it++;
+            } else {
+                auto predict = it == input.end() ? predictMap_.end() : predictMap_.find({symbol, *it});
+                if (predict == predictMap_.end()) {
+                    if (!skip(getExpected(symbol))) {
+                        return;
+                    }
+                    continue;
+                }
+                stack.pop();
+                auto &&rule = grammar_.getRules().at(predict->second);
+                stack.push(data{&rule});
+                for (auto body = rule.getBody().rbegin(); body != rule.getBody().rend(); body++) {
+                    stack.push(data{*body});
+                }
+            }
+        }
+        while (it == input.end() || *it != "$"_sym) {
+            if (!skip({"$"_sym})) {
+                return;
+            }
+        }
+    }
+
+    const Grammar &grammar_;
+    size_t         parseBudget_ = 0;
+    std::map<std::pair<Symbol, Symbol>, size_t>
+        predictMap_;
+    std::vector<Conflict>
+        conflicts_;
+};
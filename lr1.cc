@@ -1,36 +1,317 @@
 #include "lr1.hh"
 #include "cst.hh"
+#include "memory.hh"
 #include "table.hh"
+#include <algorithm>
+#include <cassert>
+#include <expected>
+#include <functional>
 #include <memory>
+#include <numeric>
+#include <optional>
+#include <queue>
+#include <ranges>
+#include <set>
 #include <stack>
+#include <stdexcept>
+#include <utility>
 
-auto LR1Parser::computeNext(const ItemSet &items, Symbol symbol) -> ItemSet {
-    ItemSet result{};
+// bytes of one item set, its items included
+static auto bytesOf(const LR1Parser::ItemSet &items) -> size_t {
+    size_t result = items.bucket_count() * sizeof(void *);
     for (auto &&item : items) {
-        if (item.getCurrentSymbol() == symbol) {
-            result.insert(item.advance());
+        result += memory::hashNode<Item> + memory::heapOf(item.getRule());
+    }
+    return result;
+}
+
+auto LR1Parser::build(size_t budget) -> size_t {
+    // breadth first from the start states, a kernel is closed only the first
+    // time it is reached
+    handleMap_.clear();
+    kernelMap_.clear();
+    transitionMap_.clear();
+    startMap_.clear();
+    nItemSet_ = 0;
+
+    auto workList = std::queue<ItemSetHandle>{};
+    auto used     = size_t{0};
+    auto discover = [&](ItemSet kernel) -> ItemSetHandle {
+        auto [it, inserted] = kernelMap_.emplace(std::move(kernel), nItemSet_);
+        if (inserted) {
+            auto &&closed = handleMap_.emplace(nItemSet_, closure(it->first)).first->second;
+            used += bytesOf(closed) + bytesOf(it->first);
+            workList.push(nItemSet_++);
+        }
+        return it->second;
+    };
+
+    for (auto &&start : grammar_.getStartSymbols()) {
+        startMap_.emplace(start, discover(ItemSet{Item{Grammar::getEntryRule(start), "$"_sym}}));
+    }
+    while (!workList.empty()) {
+        if (budget != 0 && used > budget) {
+            return used;
+        }
+        auto id = workList.front();
+        workList.pop();
+        for (auto &&[symbol, kernel] : computeNext(handleMap_.at(id))) {
+            transitionMap_.emplace(std::pair{id, symbol}, discover(std::move(kernel)));
+            used += memory::mapNode<std::pair<const std::pair<ItemSetHandle, Symbol>, ItemSetHandle>>;
+        }
+    }
+    released_ = false;
+    return used;
+}
+
+auto LR1Parser::touches(const Item &item, const Affected &affected) -> bool {
+    // the items an item adds to a closure come from the rules of its current
+    // symbol, their lookaheads from FIRST of the symbols after it, which
+    // stops at the first one that is not nullable. a symbol whose
+    // nullability changed is in `firsts`, so the current answer is enough
+    if (item.isDone()) {
+        return false;
+    } else if (affected.heads.contains(item.getCurrentSymbol())) {
+        return true;
+    }
+    auto &&body = item.getRule().getBody();
+    for (auto &&symbol : std::ranges::subrange(body.begin() + item.getDot() + 1, body.end())) {
+        if (affected.firsts.contains(symbol)) {
+            return true;
+        } else if (!fSolver_.nullable(symbol)) {
+            return false;
+        }
+    }
+    return false;
+}
+
+auto LR1Parser::patch(const Affected &affected) -> std::set<ItemSetHandle> {
+    // states with an item touching an affected symbol are closed again and
+    // their edges recomputed, kernels not seen before become new states
+    auto rows     = std::set<ItemSetHandle>{};
+    auto workList = std::queue<ItemSetHandle>{};
+    for (auto &&[handle, items] : handleMap_) {
+        if (std::ranges::any_of(items, [this, &affected](auto &&item) { return touches(item, affected); })) {
+            rows.insert(handle);
+            workList.push(handle);
+        }
+    }
+    if (rows.empty()) {
+        return rows;
+    }
+
+    // keys of kernelMap_ stay put when it rehashes
+    auto kernels = std::unordered_map<ItemSetHandle, const ItemSet *>{};
+    for (auto &&[kernel, handle] : kernelMap_) {
+        if (rows.contains(handle)) {
+            kernels.emplace(handle, &kernel);
+        }
+    }
+    while (!workList.empty()) {
+        auto id = workList.front();
+        workList.pop();
+        auto &&closed = handleMap_[id] = closure(*kernels.at(id));
+        transitionMap_.erase(transitionMap_.lower_bound({id, Symbol::mkNTerm("")}),
+                             transitionMap_.lower_bound({id + 1, Symbol::mkNTerm("")}));
+        for (auto &&[symbol, kernel] : computeNext(closed)) {
+            auto [it, inserted] = kernelMap_.emplace(std::move(kernel), nItemSet_);
+            if (inserted) {
+                kernels.emplace(nItemSet_, &it->first);
+                rows.insert(nItemSet_);
+                workList.push(nItemSet_++);
+            }
+            transitionMap_.emplace(std::pair{id, symbol}, it->second);
+        }
+    }
+    collect(rows);
+    return rows;
+}
+
+auto LR1Parser::collect(std::set<ItemSetHandle> &rows) -> void {
+    auto successors = std::vector<std::vector<ItemSetHandle>>(nItemSet_);
+    for (auto &&[key, to] : transitionMap_) {
+        successors[key.first].push_back(to);
+    }
+    auto reached = std::vector<bool>(nItemSet_);
+    auto stack   = std::stack<ItemSetHandle>{};
+    for (auto &&handle : startMap_ | std::views::values) {
+        stack.push(handle);
+    }
+    while (!stack.empty()) {
+        auto handle = stack.top();
+        stack.pop();
+        if (!reached[handle]) {
+            reached[handle] = true;
+            for (auto &&next : successors[handle]) {
+                stack.push(next);
+            }
+        }
+    }
+    size_t count = std::ranges::count(reached, true);
+    if (count == nItemSet_) {
+        return;
+    }
+
+    // reached states past the new end move into the holes below it, the
+    // others keep their handle
+    auto index = std::vector<ItemSetHandle>(nItemSet_);
+    std::iota(index.begin(), index.end(), 0);
+    ItemSetHandle hole = 0;
+    for (ItemSetHandle handle = count; handle < nItemSet_; handle++) {
+        if (reached[handle]) {
+            while (reached[hole]) {
+                hole++;
+            }
+            index[handle] = hole++;
+        }
+    }
+
+    // moved states and the states with an edge to one get their rows again
+    auto moved = std::set<ItemSetHandle>{};
+    for (auto &&row : rows) {
+        if (reached[row]) {
+            moved.insert(index[row]);
+        }
+    }
+    for (ItemSetHandle handle = count; handle < nItemSet_; handle++) {
+        if (reached[handle]) {
+            moved.insert(index[handle]);
+        }
+    }
+    for (auto &&[key, to] : transitionMap_) {
+        if (reached[key.first] && index[to] != to) {
+            moved.insert(index[key.first]);
+            moved.insert(index[to]);
+        }
+    }
+    rows = std::move(moved);
+
+    std::erase_if(handleMap_, [&reached](auto &&entry) { return !reached[entry.first]; });
+    for (ItemSetHandle handle = count; handle < nItemSet_; handle++) {
+        if (reached[handle]) {
+            auto node  = handleMap_.extract(handle);
+            node.key() = index[handle];
+            handleMap_.insert(std::move(node));
+        }
+    }
+    std::erase_if(kernelMap_, [&reached](auto &&entry) { return !reached[entry.second]; });
+    for (auto &&handle : kernelMap_ | std::views::values) {
+        handle = index[handle];
+    }
+    auto transitionMap = std::map<std::pair<ItemSetHandle, Symbol>, ItemSetHandle>{};
+    for (auto &&[key, to] : transitionMap_) {
+        if (reached[key.first]) {
+            transitionMap.emplace(std::pair{index[key.first], key.second}, index[to]);
         }
     }
-    return closure(result);
+    transitionMap_ = std::move(transitionMap);
+    for (auto &&handle : startMap_ | std::views::values) {
+        handle = index[handle];
+    }
+    nItemSet_ = count;
+}
+
+auto LR1Parser::update(const std::vector<Rule> &added,
+                       const std::vector<Rule> &removed) -> std::vector<TableT::Change> {
+    auto affected = Affected{{}, fSolver_.update()};
+    for (auto &&rule : added) {
+        affected.heads.insert(rule.getHead());
+    }
+    for (auto &&rule : removed) {
+        affected.heads.insert(rule.getHead());
+    }
+
+    // the template of a nonterminal without rules is empty, so its own
+    // symbol has to be checked as well as its items
+    std::erase_if(closureTemplates_, [this, &affected](auto &&entry) {
+        return affected.heads.contains(entry.first.first)
+               || std::ranges::any_of(entry.second, [this, &affected](auto &&item) {
+                      return touches(item, affected);
+                  });
+    });
+
+    if (released_) {
+        // nothing left to patch
+        build(0);
+        if (!table_) {
+            return {};
+        }
+        auto before = std::move(table_);
+        genTable();
+        return before->diff(*table_);
+    }
+
+    auto before = table_ ? std::optional<TableT>{*table_} : std::nullopt;
+    auto rows   = patch(affected);
+    if (!table_) {
+        return {};
+    }
+    table_->resize(nItemSet_);
+    for (auto &&row : rows) {
+        table_->clearRow(row);
+        genRow(row);
+    }
+    return before->diff(*table_);
+}
+
+auto LR1Parser::computeNext(const ItemSet &items) -> std::map<Symbol, ItemSet> {
+    // kernels of goto(items, X) for every X after a dot, closed by the caller
+    auto result = std::map<Symbol, ItemSet>{};
+    for (auto &&item : items) {
+        if (!item.isDone()) {
+            result[item.getCurrentSymbol()].insert(item.advance());
+        }
+    }
+    return result;
 }
 
 auto LR1Parser::closure(const ItemSet &items) -> ItemSet {
     ItemSet result{items};
+    for (auto &&item : items) {
+        Symbol symbol = item.getCurrentSymbol();
+        if (symbol.isTerminal()) {
+            continue;
+        }
+        // [A->α*Bβ, a] adds closure{[B->*γ, b] | b ∈ FIRST(βa)}
+        for (auto &&lookAhead : fSolver_.getFirst(item.getRestSymbols(), item.getLookAhead())) {
+            auto &&extra = getClosureTemplate(symbol, lookAhead);
+            result.insert(extra.begin(), extra.end());
+        }
+    }
+    return result;
+}
 
-    bool changed;
-    do {
-        changed = false;
-        for (auto &&item : result) {
-            Symbol symbol = item.getCurrentSymbol();
+auto LR1Parser::getClosureTemplate(Symbol symbol, Symbol lookAhead) -> const ItemSet & {
+    // closure{[B->*γ, b]} for every rule of B, memoized per (B, b)
+    auto key = std::pair{symbol, lookAhead};
+    if (closureTemplates_.contains(key)) {
+        return closureTemplates_.at(key);
+    }
 
-            for (auto &&rule : grammar_.getRulesWith(symbol)) {
-                for (auto &&lookAhead : fSolver_.getFirst(item.getRestSymbols(), item.getLookAhead())) {
-                    changed |= result.insert({rule, lookAhead}).second;
-                }
+    ItemSet          result{};
+    std::queue<Item> workList{};
+    for (auto &&rule : grammar_.getRulesWith(symbol)) {
+        workList.push(Item{rule, lookAhead});
+    }
+    while (!workList.empty()) {
+        auto item = workList.front();
+        workList.pop();
+        if (!result.insert(item).second) {
+            continue;
+        }
+
+        Symbol next = item.getCurrentSymbol();
+        if (next.isTerminal()) {
+            continue;
+        }
+        auto lookAheads = fSolver_.getFirst(item.getRestSymbols(), item.getLookAhead());
+        for (auto &&rule : grammar_.getRulesWith(next)) {
+            for (auto &&b : lookAheads) {
+                workList.push(Item{rule, b});
             }
         }
-    } while (changed);
-    return result;
+    }
+    return closureTemplates_.emplace(key, std::move(result)).first->second;
 }
 
 auto LR1Parser::resolver(TableT::Action x, TableT::Action y, Symbol symbol) -> TableT::Action {
@@ -41,32 +322,172 @@ auto LR1Parser::resolver(TableT::Action x, TableT::Action y, Symbol symbol) -> T
     std::abort();
 }
 
+auto LR1Parser::mk(const Grammar &grammar, size_t budget) -> std::expected<LR1Parser, memory::OverBudget> {
+    auto parser = LR1Parser{grammar, deferred{}};
+    if (auto used = parser.build(budget); budget != 0 && used > budget) {
+        return std::unexpected(memory::OverBudget{budget, used});
+    }
+    parser.genTable();
+    if (auto used = parser.getUsage().total(); budget != 0 && used > budget) {
+        return std::unexpected(memory::OverBudget{budget, used});
+    }
+    return parser;
+}
+
+auto LR1Parser::getUsage() const -> memory::Usage {
+    auto usage = memory::Usage{};
+
+    usage.itemSets = handleMap_.bucket_count() * sizeof(void *);
+    for (auto &&items : handleMap_ | std::views::values) {
+        usage.itemSets += memory::hashNode<std::pair<const ItemSetHandle, ItemSet>> + bytesOf(items);
+    }
+    usage.kernels = kernelMap_.bucket_count() * sizeof(void *);
+    for (auto &&items : kernelMap_ | std::views::keys) {
+        usage.kernels += memory::hashNode<std::pair<const ItemSet, ItemSetHandle>> + bytesOf(items);
+    }
+    for (auto &&key : transitionMap_ | std::views::keys) {
+        usage.transitions += memory::mapNode<std::pair<const std::pair<ItemSetHandle, Symbol>, ItemSetHandle>>
+                             + memory::heapOf(key.second);
+    }
+    for (auto &&items : closureTemplates_ | std::views::values) {
+        usage.templates += memory::mapNode<std::pair<const std::pair<Symbol, Symbol>, ItemSet>> + bytesOf(items);
+    }
+    usage.analyses = fSolver_.getBytes();
+    if (table_) {
+        usage.table = sizeof(TableT) + table_->getBytes();
+    }
+    return usage;
+}
+
+auto LR1Parser::release() -> void {
+    // swapped out rather than cleared so that the buckets go too
+    std::exchange(handleMap_, {});
+    std::exchange(kernelMap_, {});
+    std::exchange(transitionMap_, {});
+    std::exchange(closureTemplates_, {});
+    fSolver_.release();
+    released_ = true;
+}
+
 auto LR1Parser::genTable() -> void {
+    // the item sets are gone, the table would come out empty
+    if (released_) {
+        throw std::logic_error{"LR1Parser::genTable after release"};
+    }
+    assert(handleMap_.size() == nItemSet_);
     table_ = std::make_unique<TableT>(nItemSet_, grammar_, resolver);
-    for (auto &&[handle, itemSet] : handleMap_) {
-        for (auto &&item : itemSet) {
-            if (item.isDone()) {
-                auto lookAhead = item.getLookAhead();
-                if (item.getRule() == grammar_.getStartRule()) {
-                    // [S'->S*, $]
-                    table_->setAction(handle, lookAhead, TableT::Action::mkAccept());
-                } else {
-                    // [A->α*, a]
-                    table_->setAction(handle, lookAhead, TableT::Action::mkReduce(item.getRule()));
-                }
+    for (ItemSetHandle handle = 0; handle < nItemSet_; handle++) {
+        genRow(handle);
+    }
+}
+
+auto LR1Parser::genRow(ItemSetHandle handle) -> void {
+    for (auto &&item : handleMap_.at(handle)) {
+        if (item.isDone()) {
+            auto lookAhead = item.getLookAhead();
+            if (grammar_.isEntryRule(item.getRule())) {
+                // [<S>'->S*, $]
+                table_->setAction(handle, lookAhead, TableT::Action::mkAccept());
             } else {
-                auto currentSymbol = item.getCurrentSymbol();
-                if (currentSymbol.isTerminal()) {
-                    auto nextState = getNext(handle, currentSymbol).value();
-                    table_->setAction(handle, currentSymbol, TableT::Action::mkShift(nextState));
-                }
+                // [A->α*, a]
+                table_->setAction(handle, lookAhead, TableT::Action::mkReduce(item.getRule()));
             }
+        } else {
+            auto currentSymbol = item.getCurrentSymbol();
+            if (currentSymbol.isTerminal()) {
+                auto nextState = getNext(handle, currentSymbol).value();
+                table_->setAction(handle, currentSymbol, TableT::Action::mkShift(nextState));
+            }
+        }
+    }
+    auto first = transitionMap_.lower_bound({handle, Symbol::mkNTerm("")});
+    for (auto it = first; it != transitionMap_.end() && it->first.first == handle; it++) {
+        if (!it->first.second.isTerminal()) {
+            table_->setTransition(handle, it->first.second, it->second);
+        }
+    }
+}
+
+auto LR1Parser::renumber(const TableT::Profile &profile) -> void {
+    auto countOf = [&profile](ItemSetHandle handle) -> size_t {
+        return handle < profile.stateCount.size() ? profile.stateCount[handle] : 0;
+    };
+
+    auto hottest = std::vector<ItemSetHandle>(nItemSet_);
+    std::iota(hottest.begin(), hottest.end(), 0);
+    std::stable_sort(hottest.begin(), hottest.end(), [&countOf](auto &&x, auto &&y) {
+        return countOf(x) > countOf(y);
+    });
+
+    auto successors = std::vector<std::vector<std::pair<size_t, ItemSetHandle>>>(nItemSet_);
+    for (auto &&[edge, count] : profile.edgeCount) {
+        // a profile recorded before an update() may name states that are gone
+        if (edge.first < nItemSet_ && edge.second < nItemSet_) {
+            successors[edge.first].emplace_back(count, edge.second);
         }
-        for (auto &&symbol : grammar_.getNTerms()) {
-            auto nextState = getNext(handle, symbol);
-            if (nextState.has_value()) {
-                table_->setTransition(handle, symbol, nextState.value());
+    }
+    for (auto &&edges : successors) {
+        std::ranges::sort(edges, std::greater{});
+    }
+
+    // chains follow the hottest untaken edge, so that states visited one after
+    // another end up next to each other. start states are placed first, the
+    // default entry's at 0
+    auto order  = std::vector<ItemSetHandle>{};
+    auto placed = std::vector<bool>(nItemSet_);
+    auto place  = [&](ItemSetHandle handle) {
+        while (!placed[handle]) {
+            placed[handle] = true;
+            order.push_back(handle);
+            for (auto &&[count, next] : successors[handle]) {
+                if (!placed[next]) {
+                    handle = next;
+                    break;
+                }
             }
         }
+    };
+    for (auto &&start : grammar_.getStartSymbols()) {
+        place(startMap_.at(start));
+    }
+    for (auto &&handle : hottest) {
+        place(handle);
+    }
+
+    auto index = std::vector<ItemSetHandle>(nItemSet_);
+    for (size_t i = 0; i < nItemSet_; i++) {
+        index[order[i]] = i;
+    }
+
+    for (auto &&handle : startMap_ | std::views::values) {
+        handle = index[handle];
+    }
+
+    auto handleMap = std::unordered_map<ItemSetHandle, ItemSet>{};
+    for (auto &&[handle, itemSet] : handleMap_) {
+        handleMap.emplace(index[handle], std::move(itemSet));
+    }
+    handleMap_ = std::move(handleMap);
+
+    for (auto &&handle : kernelMap_ | std::views::values) {
+        handle = index[handle];
+    }
+
+    auto transitionMap = std::map<std::pair<ItemSetHandle, Symbol>, ItemSetHandle>{};
+    for (auto &&[key, to] : transitionMap_) {
+        transitionMap.emplace(std::pair{index[key.first], key.second}, index[to]);
+    }
+    transitionMap_ = std::move(transitionMap);
+
+    // hottest lookahead columns first, so the entries a hot row is read at
+    // share cache lines
+    auto columns = std::vector<std::pair<size_t, Symbol>>{};
+    for (auto &&[symbol, count] : profile.symbolCount) {
+        columns.emplace_back(count, symbol);
+    }
+    std::ranges::sort(columns, std::greater{});
+    if (table_) {
+        auto symbols = columns | std::views::values;
+        table_->renumber(order, {symbols.begin(), symbols.end()});
     }
 }
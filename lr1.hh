@@ -1,20 +1,26 @@
 #pragma once
 
 #include "cst.hh"
+#include "error.hh"
 #include "grammar.hh"
+#include "memory.hh"
 #include "table.hh"
 #include "utils.hh"
 
 #include <bits/ranges_base.h>
 #include <cassert>
+#include <compare>
 #include <concepts>
+#include <expected>
 #include <functional>
 #include <map>
 #include <memory>
 #include <numeric>
+#include <optional>
 #include <ostream>
 #include <queue>
 #include <stack>
+#include <tuple>
 #include <unordered_map>
 #include <unordered_set>
 #include <utility>
@@ -28,11 +34,7 @@ concept input_stream = requires(T &t) {
 class Item {
   public:
     struct hash {
-        auto operator()(const Item &item) const -> size_t {
-            return Rule::hash{}(item.rule_)
-                   * Symbol::hash{}(item.lookAhead_)
-                   * (item.dot_ + 233);
-        }
+        auto operator()(const Item &item) const -> size_t { return item.hash_; }
     };
 
     Item(Rule rule, Symbol lookAhead) :
@@ -44,7 +46,7 @@ class Item {
         return {rule_, lookAhead_, dot_ + 1};
     }
     auto isDone() const -> bool { return dot_ == rule_.getBody().size(); }
-    auto getRule() const -> Rule { return rule_; }
+    auto getRule() const -> const Rule & { return rule_; }
     auto getLookAhead() const -> Symbol { return lookAhead_; }
     auto getCurrentSymbol() const -> Symbol {
         return isDone() ? ""_sym : rule_.getBody().at(dot_);
@@ -53,18 +55,28 @@ class Item {
         return {rule_.getBody().begin() + dot_ + 1,
                 rule_.getBody().end()};
     }
-    auto operator<=>(const Item &) const = default;
+    auto getDot() const -> size_t { return dot_; }
+    auto operator==(const Item &other) const -> bool {
+        return hash_ == other.hash_ && dot_ == other.dot_ && lookAhead_ == other.lookAhead_ && rule_ == other.rule_;
+    }
+    auto operator<=>(const Item &other) const -> std::strong_ordering {
+        return std::tie(rule_, lookAhead_, dot_) <=> std::tie(other.rule_, other.lookAhead_, other.dot_);
+    }
 
   private:
     Item(Rule rule, Symbol lookAhead, size_t dot) :
-      rule_(rule),
-      lookAhead_(lookAhead),
-      dot_(dot) {
+      rule_(std::move(rule)),
+      lookAhead_(std::move(lookAhead)),
+      dot_(dot),
+      // items are copied and compared far more often than they are made,
+      // and hashing a rule walks every name in it
+      hash_(hashCombine(hashCombine(Rule::hash{}(rule_), Symbol::hash{}(lookAhead_)), dot_)) {
     }
 
     Rule   rule_;
     Symbol lookAhead_;
     size_t dot_;
+    size_t hash_;
 };
 
 class LR1Parser {
@@ -75,52 +87,33 @@ class LR1Parser {
 
     struct hash {
         auto operator()(const ItemSet &items) const -> size_t {
+            // a sum, the iteration order of equal sets may differ
             return std::transform_reduce(
                 items.cbegin(),
                 items.cend(),
-                1,
-                [](auto &&x, auto &&y) {
-                    return x * y;
-                },
-                Item::hash{});
+                size_t{0},
+                std::plus{},
+                [](auto &&item) {
+                    // spread the bits first, close items would cancel out
+                    auto x = Item::hash{}(item);
+                    x      = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+                    x      = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+                    return x ^ (x >> 31);
+                });
         }
     };
 
     LR1Parser(const Grammar &grammar) :
-      grammar_(grammar),
-      fSolver_(grammar),
-      nItemSet_(0) {
-        ItemSet startSet = closure({Item{grammar.getStartRule(), "$"_sym}});
-
-        std::queue<ItemSetHandle> workList{};
-        workList.push(getStartHandle());
-
-        std::unordered_map<ItemSet, ItemSetHandle, hash> itemSetMap{};
-        itemSetMap.emplace(startSet, getStartHandle());
-
-        handleMap_ = {{getStartHandle(), startSet}};
-        nItemSet_++;
-
-        while (!workList.empty()) {
-            auto &&items = workList.front();
-            workList.pop();
-            for (auto &&symbol : grammar.getSymbols()) {
-                for (auto &&symbol : grammar.getSymbols()) {
-                    ItemSet newSet = computeNext(handleMap_.at(items), symbol);
-                    if (!newSet.empty()) {
-                        if (!itemSetMap.contains(newSet)) {
-                            itemSetMap.emplace(newSet, nItemSet_);
-                            handleMap_.emplace(nItemSet_, newSet);
-                            workList.push(nItemSet_++);
-                        }
-                        transitionMap_[{items, symbol}] = itemSetMap.at(newSet);
-                    }
-                }
-            }
-        }
+      LR1Parser(grammar, deferred{}) {
+        build(0);
     }
 
-    auto getStartHandle() const -> ItemSetHandle { return 0; }
+    // builds the automaton and the table, giving up as soon as they would
+    // take more than `budget` bytes, 0 for no limit
+    static auto mk(const Grammar &grammar, size_t budget) -> std::expected<LR1Parser, memory::OverBudget>;
+
+    auto getStartHandle() const -> ItemSetHandle { return getStartHandle(grammar_.getStartSymbol()); }
+    auto getStartHandle(Symbol entry) const -> ItemSetHandle { return startMap_.at(entry); }
     auto getItemSet(ItemSetHandle handle) -> ItemSet { return handleMap_.at(handle); }
     auto getNext(ItemSetHandle handle, Symbol symbol) const noexcept -> std::optional<ItemSetHandle> {
         if (transitionMap_.contains({handle, symbol})) {
@@ -134,60 +127,179 @@ class LR1Parser {
     auto genTable() -> void;
     auto getTable() const -> const TableT & { return *table_; }
 
+    auto getUsage() const -> memory::Usage;
+    // drops everything only needed to build the table. parse and renumber
+    // keep working, update() rebuilds from scratch, getItemSet/getNext no
+    // longer answer and genTable throws std::logic_error until an update()
+    auto release() -> void;
+    // bytes of stack and tree a parse may use, 0 for no limit
+    auto setParseBudget(size_t budget) -> void { parseBudget_ = budget; }
+
+    // call after rules were added to or removed from the grammar, only
+    // states mentioning a changed symbol are closed again and only their
+    // table rows written
+    auto update(const std::vector<Rule> &added,
+                const std::vector<Rule> &removed) -> std::vector<TableT::Change>;
+
+    // reorders states and lookahead columns by a recorded profile, hot ones
+    // first, states and edges the parser no longer has are ignored
+    auto renumber(const TableT::Profile &profile) -> void;
+
     template <typename RangeT>
-    auto parse(const RangeT &input) const -> cst::Node {
-        using namespace cst;
+    auto parse(const RangeT &input, TableT::Profile *profile = nullptr) const -> std::expected<cst::Node, ParseError> {
+        return parse(input, grammar_.getStartSymbol(), profile);
+    }
 
-        auto stateStack = std::stack<ItemSetHandle>{{getStartHandle()}};
-        auto nodeStack  = std::stack<Node>{};
+    template <typename RangeT>
+    auto parse(const RangeT &input, Symbol entry, TableT::Profile *profile = nullptr) const -> std::expected<cst::Node, ParseError> {
+        if (grammar_.hasAnnotations()) {
+            auto projector = cst::Projector{grammar_};
+            if (auto result = parse(input, entry, projector, profile); !result.has_value()) {
+                return std::unexpected(std::move(result.error()));
+            }
+            return projector.getResult();
+        }
+        auto builder = cst::Builder{};
+        if (auto result = parse(input, entry, builder, profile); !result.has_value()) {
+            return std::unexpected(std::move(result.error()));
+        }
+        return builder.getResult();
+    }
+
+    // drives `sink` with shift(symbol, position) and reduce(rule) events, in
+    // the order the parser performs them. stops at the first error
+    template <typename RangeT, typename SinkT>
+    auto parse(const RangeT &input, Symbol entry, SinkT &sink, TableT::Profile *profile = nullptr) const -> std::expected<void, ParseError> {
+        auto error = std::optional<ParseError>{};
+        drive(input, entry, sink, profile, [&error](ParseError &&e) {
+            error = std::move(e);
+            return false;
+        });
+        if (error.has_value()) {
+            return std::unexpected(std::move(error.value()));
+        }
+        return {};
+    }
+
+    // panic mode, tokens no action exists for are skipped so that one pass
+    // reports every error. the sink only sees the tokens that were kept
+    template <typename RangeT, typename SinkT>
+    auto recover(const RangeT &input, Symbol entry, SinkT &sink) const -> std::vector<ParseError> {
+        auto errors = std::vector<ParseError>{};
+        drive(input, entry, sink, nullptr, [&errors](ParseError &&e) {
+            errors.push_back(std::move(e));
+            return true;
+        });
+        return errors;
+    }
+
+  private:
+    // `onError` returns whether to skip the offending token and go on
+    template <typename RangeT, typename SinkT, typename FuncT>
+    auto drive(const RangeT &input, Symbol entry, SinkT &sink, TableT::Profile *profile, FuncT &&onError) const -> void {
+        if (profile != nullptr) {
+            profile->stateCount.resize(nItemSet_);
+        }
+
+        size_t position   = 0;
+        auto   stateStack = std::stack<ItemSetHandle>{{getStartHandle(entry)}};
         for (auto it = input.begin(); it != input.end();) {
             auto symbol = *it;
-            auto action = table_->getAction(stateStack.top(), symbol).value();
-            switch (action.kind) {
+            if (parseBudget_ != 0) {
+                auto used = stateStack.size() * sizeof(ItemSetHandle) + memory::sinkBytes(sink);
+                if (used > parseBudget_) {
+                    onError(memory::OverBudget{parseBudget_, used});
+                    return;
+                }
+            }
+            auto column = table_->getColumn(symbol);
+            if (!column.has_value() || !table_->getCell(stateStack.top(), column.value()).set) {
+                auto expected = table_->getExpected(stateStack.top());
+                if (!onError(SyntaxError{position, symbol, std::move(expected)}) || symbol == "$"_sym) {
+                    return;
+                }
+                position++;
+                it++;
+                continue;
+            }
+            auto &&cell = table_->getCell(stateStack.top(), column.value());
+            if (profile != nullptr) {
+                profile->stateCount[stateStack.top()]++;
+                profile->symbolCount[symbol]++;
+            }
+            switch (cell.kind) {
                 case TableT::SHIFT: {
-                    stateStack.push(action.state);
-                    nodeStack.push(Node{symbol.getName()});
+                    if (profile != nullptr) {
+                        profile->edgeCount[{stateStack.top(), cell.value}]++;
+                    }
+                    stateStack.push(cell.value);
+                    sink.shift(symbol, position++);
                     it++;
                     break;
                 }
                 case TableT::REDUCE: {
-                    auto body = std::deque<Node>{};
-                    auto rule = action.rule.value();
+                    auto &&rule = table_->getRule(cell.value);
                     for (size_t i = 0; i < rule.getBody().size(); i++) {
-                        body.push_front(nodeStack.top());
-                        nodeStack.pop();
                         stateStack.pop();
                     }
-                    stateStack.push(table_->getTransition(stateStack.top(), rule.getHead()).value());
-
-                    auto node = Node{rule.getHead().getName()};
-                    for (auto child : body) {
-                        node.getChildren()
-                            .push_back(child);
+                    auto next = table_->getGoto(stateStack.top(), cell.value);
+                    if (profile != nullptr) {
+                        profile->edgeCount[{stateStack.top(), next}]++;
                     }
-                    nodeStack.push(node);
+                    stateStack.push(next);
+                    sink.reduce(rule);
                     break;
                 }
                 case TableT::ACCEPT: {
-                    return nodeStack.top();
-                    break;
+                    return;
                 }
             }
         }
-        std::abort();
+        onError(SyntaxError{position, "$"_sym, table_->getExpected(stateStack.top())});
     }
 
-  private:
-    auto computeNext(const ItemSet &items, Symbol symbol) -> ItemSet;
+    struct deferred {};
+    LR1Parser(const Grammar &grammar, deferred) :
+      grammar_(grammar),
+      fSolver_(grammar),
+      nItemSet_(0) {
+    }
+
+    // returns the bytes accounted, stops early once they exceed a non-zero
+    // budget
+    auto build(size_t budget) -> size_t;
+    // heads whose rules changed, symbols whose FIRST or nullable changed
+    struct Affected {
+        std::set<Symbol> heads;
+        std::set<Symbol> firsts;
+    };
+    // whether the items `item` adds to a closure may have changed
+    auto touches(const Item &item, const Affected &affected) -> bool;
+    // closes again the states an affected symbol may change and whatever
+    // they now reach, returns the handles whose table rows are stale
+    auto patch(const Affected &affected) -> std::set<ItemSetHandle>;
+    // drops states no longer reachable, keeping handles dense, and remaps
+    // `rows` to the new handles
+    auto collect(std::set<ItemSetHandle> &rows) -> void;
+    auto computeNext(const ItemSet &items) -> std::map<Symbol, ItemSet>;
+    auto genRow(ItemSetHandle handle) -> void;
     auto closure(const ItemSet &items) -> ItemSet;
+    auto getClosureTemplate(Symbol symbol, Symbol lookAhead) -> const ItemSet &;
 
     const Grammar &grammar_;
     First          fSolver_;
-    size_t         nItemSet_ = 0;
+    size_t         nItemSet_    = 0;
+    size_t         parseBudget_ = 0;
+    bool           released_    = false;
     std::unique_ptr<TableT>
         table_;
 
+    std::map<Symbol, ItemSetHandle>            startMap_;
     std::unordered_map<ItemSetHandle, ItemSet> handleMap_;
+    std::unordered_map<ItemSet, ItemSetHandle, hash>
+        kernelMap_;
     std::map<std::pair<ItemSetHandle, Symbol>, ItemSetHandle>
         transitionMap_;
+    std::map<std::pair<Symbol, Symbol>, ItemSet>
+        closureTemplates_;
 };
@@ -1,10 +1,73 @@
+#include "cst_binary.hh"
+#include "generator.hh"
 #include "grammar.hh"
+#include "ll1.hh"
 #include "lr1.hh"
 #include "utils.hh"
 
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
-[[maybe_unused]] static auto testFollow() -> void {
+static int failures = 0;
+
+static auto check(bool ok, const std::string &what) -> void {
+    if (!ok) {
+        std::cerr << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+template <typename T>
+static auto render(const T &x) -> std::string {
+    auto os = std::ostringstream{};
+    os << x;
+    return os.str();
+}
+
+// "x + x $" -> {x, +, x, $}
+static auto lex(const std::string &text) -> std::vector<Symbol> {
+    auto result = std::vector<Symbol>{};
+    auto is     = std::istringstream{text};
+    for (std::string word; is >> word;) {
+        result.push_back(operator""_sym(word.c_str(), word.size()));
+    }
+    return result;
+}
+
+static auto exprGrammar() -> Grammar {
+    return Grammar::mk(
+        "E"_sym,
+        Rule::mk("E"_sym).of("E"_sym, "+"_sym, "T"_sym),
+        Rule::mk("E"_sym).of("T"_sym),
+        Rule::mk("T"_sym).of("T"_sym, "*"_sym, "F"_sym),
+        Rule::mk("T"_sym).of("F"_sym),
+        Rule::mk("F"_sym).of("("_sym, "E"_sym, ")"_sym),
+        Rule::mk("F"_sym).of("x"_sym));
+}
+
+// tree of "x * x + x $" in exprGrammar
+static const auto exprTree = std::string{
+    "E\n"
+    "  E\n"
+    "    T\n"
+    "      T\n"
+    "        F\n"
+    "          x\n"
+    "      *\n"
+    "      F\n"
+    "        x\n"
+    "  +\n"
+    "  T\n"
+    "    F\n"
+    "      x\n"};
+
+static auto testFollow() -> void {
     auto grammar = Grammar::mk(
         "E"_sym,
         Rule::mk("E"_sym).of("T"_sym, "A"_sym),
@@ -17,49 +80,366 @@
         Rule::mk("F"_sym).of("x"_sym));
 
     auto follow = Follow{grammar};
-    std::cout << follow.getFollow("E"_sym);
-    std::cout << follow.getFollow("A"_sym);
-    std::cout << follow.getFollow("T"_sym);
-    std::cout << follow.getFollow("B"_sym);
-    std::cout << follow.getFollow("F"_sym);
+    check(follow.getFollow("E"_sym) == std::set{"$"_sym, ")"_sym}, "follow E");
+    check(follow.getFollow("A"_sym) == std::set{"$"_sym, ")"_sym}, "follow A");
+    check(follow.getFollow("T"_sym) == std::set{"$"_sym, ")"_sym, "+"_sym}, "follow T");
+    check(follow.getFollow("B"_sym) == std::set{"$"_sym, ")"_sym, "+"_sym}, "follow B");
+    check(follow.getFollow("F"_sym) == std::set{"$"_sym, ")"_sym, "*"_sym, "+"_sym}, "follow F");
 }
 
-[[maybe_unused]] static auto testLR1() -> void {
+static auto testLR1() -> void {
     auto grammar = Grammar::mk(
-        "S'"_sym,
-        Rule::mk("S'"_sym).of("S"_sym),
+        "S"_sym,
         Rule::mk("S"_sym).of("C"_sym, "C"_sym),
         Rule::mk("C"_sym).of("c"_sym, "C"_sym),
         Rule::mk("C"_sym).of("d"_sym));
 
     auto builder = LR1Parser{grammar};
     builder.genTable();
-    auto &table = builder.getTable();
-    std::cout << table;
+    check(builder.getTable().getStateCount() == 10, "lr1 state count");
+    check(builder.parse(lex("c d c c d $")).has_value(), "lr1 parse");
+
+    // nonterminals used to hash to 0, and every rule and item with them
+    auto first  = Item{Rule::mk("S"_sym).of("C"_sym, "C"_sym), "$"_sym};
+    auto second = Item{Rule::mk("C"_sym).of("c"_sym, "C"_sym), "$"_sym};
+    check(Symbol::hash{}(Symbol::mkNTerm("c")) != Symbol::hash{}(Symbol::mkTerm("c")), "lr1 symbol hash");
+    check(Item::hash{}(first) != 0 && Item::hash{}(first) != Item::hash{}(second), "lr1 item hash");
+    check(LR1Parser::hash{}({first}) != LR1Parser::hash{}({second}), "lr1 item set hash");
 }
 
-[[maybe_unused]] static auto testExpr() -> void {
+static auto testExpr() -> void {
+    auto grammar = exprGrammar();
+    auto parser  = LR1Parser{grammar};
+    parser.genTable();
+    check(parser.getTable().getStateCount() == 22, "expr state count");
+
+    auto node = parser.parse(lex("x * x + x $"));
+    check(node.has_value() && render(node.value()) == exprTree, "expr tree");
+}
+
+static auto testGenerate() -> void {
+    auto grammar = exprGrammar();
+    auto parser  = LR1Parser{grammar};
+    parser.genTable();
+
+    // same seed, same stream
+    auto first  = std::ostringstream{};
+    auto second = std::ostringstream{};
+    check(Generator::mk(grammar, 42).value().stream(256, 6, first) >= 256, "generate length");
+    Generator::mk(grammar, 42).value().stream(256, 6, second);
+    check(first.str() == second.str(), "generate seed");
+
+    auto generator = Generator::mk(grammar, 42).value();
+    for (int i = 0; i < 100; i++) {
+        auto input = std::vector<Symbol>{};
+        generator.sentence(8, [&input](Symbol symbol) { input.push_back(symbol); });
+        check(input.back() == "$"_sym && parser.parse(input).has_value(), "generate parse");
+    }
+
+    // S never stops deriving, there is no sentence to generate
+    auto endless = Grammar::mk(
+        "S"_sym,
+        Rule::mk("S"_sym).of("a"_sym, "S"_sym));
+    auto refused = Generator::mk(endless, 42);
+    check(!refused.has_value() && render(refused.error()) == "unproductive S\n", "generate unproductive");
+}
+
+static auto testProfile() -> void {
+    auto grammar = exprGrammar();
+    auto parser  = LR1Parser{grammar};
+    parser.genTable();
+
+    auto generator = Generator::mk(grammar, 42).value();
+    auto profile   = LR1Parser::TableT::Profile{};
+    auto inputs    = std::vector<std::vector<Symbol>>{};
+    auto trees     = std::vector<std::string>{};
+    for (int i = 0; i < 100; i++) {
+        auto &input = inputs.emplace_back();
+        generator.sentence(8, [&input](Symbol symbol) { input.push_back(symbol); });
+        trees.push_back(render(parser.parse(input, &profile).value()));
+    }
+    parser.renumber(profile);
+
+    check(parser.getStartHandle() == 0, "profile start state");
+    check(parser.getTable().getStateCount() == 22, "profile state count");
+    auto hottest = std::ranges::max_element(profile.symbolCount, {}, [](auto &&x) { return x.second; })->first;
+    check(parser.getTable().getColumn(hottest) == 0, "profile hottest column");
+    for (size_t i = 0; i < inputs.size(); i++) {
+        auto node = parser.parse(inputs[i]);
+        check(node.has_value() && render(node.value()) == trees[i], "profile parse");
+    }
+
+    // a stale profile naming states that no longer exist
+    auto stale = LR1Parser::TableT::Profile{std::vector<size_t>(100, 1), {{{0, 99}, 5}, {{99, 1}, 5}}};
+    parser.renumber(stale);
+    check(parser.getTable().getStateCount() == 22, "profile stale state count");
+    check(render(parser.parse(lex("x * x + x $")).value()) == exprTree, "profile stale parse");
+
+    // the default entry S sorts after E but still gets state 0
+    auto entries = Grammar::mk(
+        {"S"_sym, "E"_sym},
+        Rule::mk("S"_sym).of("x"_sym, "="_sym, "E"_sym, ";"_sym),
+        Rule::mk("E"_sym).of("E"_sym, "+"_sym, "x"_sym),
+        Rule::mk("E"_sym).of("x"_sym));
+    auto shared = LR1Parser{entries};
+    shared.genTable();
+    shared.renumber({});
+    check(shared.getStartHandle("S"_sym) == 0 && shared.getStartHandle("E"_sym) == 1, "profile entry order");
+}
+
+static auto testEntries() -> void {
     auto grammar = Grammar::mk(
-        "S'"_sym,
-        Rule::mk("S'"_sym).of("E"_sym),
-        Rule::mk("E"_sym).of("E"_sym, "+"_sym, "T"_sym),
-        Rule::mk("E"_sym).of("T"_sym),
-        Rule::mk("T"_sym).of("T"_sym, "*"_sym, "F"_sym),
-        Rule::mk("T"_sym).of("F"_sym),
+        {"S"_sym, "E"_sym},
+        Rule::mk("S"_sym).of("x"_sym, "="_sym, "E"_sym, ";"_sym),
+        Rule::mk("E"_sym).of("E"_sym, "+"_sym, "x"_sym),
+        Rule::mk("E"_sym).of("x"_sym));
+
+    auto parser = LR1Parser{grammar};
+    parser.genTable();
+
+    auto statement = parser.parse(lex("x = x + x ; $"));
+    check(statement.has_value()
+              && render(statement.value()) == "S\n  x\n  =\n  E\n    E\n      x\n    +\n    x\n  ;\n",
+          "entries statement");
+    auto expression = parser.parse(lex("x + x $"), "E"_sym);
+    check(expression.has_value() && render(expression.value()) == "E\n  E\n    x\n  +\n  x\n", "entries expression");
+    // E has several rules and shows up in its own body, none of them accepts
+    auto single = parser.parse(lex("x $"), "E"_sym);
+    check(single.has_value() && render(single.value()) == "E\n  x\n", "entries single");
+    check(!parser.parse(lex("x + $"), "E"_sym).has_value(), "entries incomplete");
+
+    auto ll1Grammar = Grammar::mk(
+        {"S"_sym, "E"_sym},
+        Rule::mk("S"_sym).of("x"_sym, "="_sym, "E"_sym, ";"_sym),
+        Rule::mk("E"_sym).of("x"_sym, "T"_sym),
+        Rule::mk("T"_sym).of("+"_sym, "x"_sym, "T"_sym),
+        Rule::mk("T"_sym).of(""_sym));
+    auto ll1      = LL1Parser{ll1Grammar};
+    auto ll1Entry = ll1.parse(lex("x + x $"), "E"_sym);
+    check(ll1Entry.has_value() && render(ll1Entry.value()) == "E\n  x\n  T\n    +\n    x\n    T\n      \n", "entries ll1");
+    check(!parser.parse(lex("x + x $")).has_value(), "entries wrong entry");
+}
+
+static auto testUpdate() -> void {
+    auto grammar = exprGrammar();
+    auto parser  = LR1Parser{grammar};
+    parser.genTable();
+
+    auto rule = Rule::mk("F"_sym).of("-"_sym, "F"_sym);
+    grammar.getRules().push_back(rule);
+    check(!parser.update({rule}, {}).empty(), "update diff");
+    {
+        auto fresh = LR1Parser{grammar};
+        fresh.genTable();
+        check(parser.getTable().getStateCount() == fresh.getTable().getStateCount(), "update state count");
+    }
+
+    auto node = parser.parse(lex("- x $"));
+    check(node.has_value() && render(node.value()) == "E\n  T\n    F\n      -\n      F\n        x\n", "update parse");
+
+    // removing the rule again gives back the original table
+    std::erase(grammar.getRules(), rule);
+    parser.update({}, {rule});
+    auto original = exprGrammar();
+    auto fresh    = LR1Parser{original};
+    fresh.genTable();
+    check(fresh.getTable().diff(parser.getTable()).empty(), "update round trip");
+
+    // first rule of a nonterminal that had none
+    auto partial = Grammar::mk(
+        "E"_sym,
+        Rule::mk("E"_sym).of("x"_sym),
+        Rule::mk("E"_sym).of("z"_sym, "N"_sym));
+    auto grown   = LR1Parser{partial};
+    grown.genTable();
+    check(!grown.parse(lex("z y $")).has_value(), "update no rules");
+    auto first = Rule::mk("N"_sym).of("y"_sym);
+    partial.getRules().push_back(first);
+    check(!grown.update({first}, {}).empty(), "update first rule diff");
+    auto filled = grown.parse(lex("z y $"));
+    check(filled.has_value() && render(filled.value()) == "E\n  z\n  N\n    y\n", "update first rule parse");
+}
+
+static auto testBinary() -> void {
+    auto grammar = exprGrammar();
+    auto parser  = LR1Parser{grammar};
+    parser.genTable();
+
+    auto path = std::filesystem::temp_directory_path() / "parsir-cst.bin";
+    {
+        auto file   = std::ofstream{path, std::ios::binary};
+        auto writer = cst::Writer{file};
+        check(parser.parse(lex("x * x + x $"), grammar.getStartSymbol(), writer).has_value(), "binary parse");
+        writer.finish();
+    }
+
+    auto reader = cst::Reader::open(path);
+    check(reader.has_value(), "binary open");
+    if (reader.has_value()) {
+        auto root = reader.value().getRoot();
+        check(reader.value().getNodeCount() == 13, "binary node count");
+        check(render(root) == exprTree, "binary tree");
+        check(root.getBegin() == 0 && root.getEnd() == 5, "binary span");
+    }
+
+    // a child count past the records before the root is rejected by open
+    // rather than walked off the mapping by getChildren
+    {
+        auto file       = std::fstream{path, std::ios::binary | std::ios::in | std::ios::out};
+        auto childCount = uint32_t{1000};
+        file.seekp(sizeof(cst::Header) + 12 * sizeof(cst::Record) + offsetof(cst::Record, childCount));
+        file.write(reinterpret_cast<const char *>(&childCount), sizeof(childCount));
+    }
+    check(!cst::Reader::open(path).has_value(), "binary corrupt child count");
+    std::filesystem::remove(path);
+}
+
+static auto testLL1() -> void {
+    auto grammar = Grammar::mk(
+        "E"_sym,
+        Rule::mk("E"_sym).of("T"_sym, "A"_sym),
+        Rule::mk("A"_sym).of("+"_sym, "T"_sym, "A"_sym),
+        Rule::mk("A"_sym).of(""_sym),
+        Rule::mk("T"_sym).of("F"_sym, "B"_sym),
+        Rule::mk("B"_sym).of("*"_sym, "F"_sym, "B"_sym),
+        Rule::mk("B"_sym).of(""_sym),
         Rule::mk("F"_sym).of("("_sym, "E"_sym, ")"_sym),
         Rule::mk("F"_sym).of("x"_sym));
 
+    auto parser = LL1Parser{grammar};
+    check(parser.isLL1(), "ll1 conflicts");
+
+    auto node = parser.parse(lex("x + x $"));
+    check(node.has_value()
+              && render(node.value()) == "E\n  T\n    F\n      x\n    B\n      \n  A\n    +\n    T\n      F\n        x\n      B\n        \n    A\n      \n",
+          "ll1 tree");
+
+    // left recursion, the table is not LL(1) and is not run
+    auto recursive = Grammar::mk(
+        "E"_sym,
+        Rule::mk("E"_sym).of("E"_sym, "+"_sym, "x"_sym),
+        Rule::mk("E"_sym).of("x"_sym));
+    auto conflicted = LL1Parser{recursive};
+    check(!conflicted.isLL1(), "ll1 left recursion");
+    auto refused = conflicted.parse(lex("x $"));
+    check(!refused.has_value()
+              && render(refused.error()) == "conflict on E, x: E->E+x, E->x\n",
+          "ll1 refuse parse");
+    auto builder = cst::Builder{};
+    auto errors  = conflicted.recover(lex("x $"), "E"_sym, builder);
+    check(errors.size() == 1 && std::holds_alternative<ConflictError>(errors[0]), "ll1 refuse recover");
+}
+
+static auto testAst() -> void {
+    auto grammar = exprGrammar();
+    grammar.setAnnotation("("_sym, Annotation::mkDrop());
+    grammar.setAnnotation(")"_sym, Annotation::mkDrop());
+    grammar.setAnnotation("+"_sym, Annotation::mkDrop());
+    grammar.setAnnotation("*"_sym, Annotation::mkDrop());
+    grammar.setAnnotation(Rule::mk("E"_sym).of("E"_sym, "+"_sym, "T"_sym), Annotation::mkLabel("Add"));
+    grammar.setAnnotation(Rule::mk("T"_sym).of("T"_sym, "*"_sym, "F"_sym), Annotation::mkLabel("Mul"));
+    grammar.setAnnotation(Rule::mk("E"_sym).of("T"_sym), Annotation::mkInline());
+    grammar.setAnnotation("F"_sym, Annotation::mkInline());
+    grammar.setAnnotation(Rule::mk("T"_sym).of("F"_sym), Annotation::mkInline());
+
     auto parser = LR1Parser{grammar};
     parser.genTable();
-    auto &table = parser.getTable();
 
-    std::cout << table;
+    auto node = parser.parse(lex("x * ( x + x ) $"));
+    check(node.has_value() && render(node.value()) == "Mul\n  x\n  Add\n    x\n    x\n", "ast tree");
+}
+
+static auto testErrors() -> void {
+    auto grammar = exprGrammar();
+    auto parser  = LR1Parser{grammar};
+    parser.genTable();
+
+    auto input = lex("x * ) x + + x $");
+    auto node  = parser.parse(input);
+    check(!node.has_value()
+              && render(node.error()) == "2: unexpected ), expected {(, x}\n",
+          "errors first");
+
+    auto builder = cst::Builder{};
+    auto errors  = parser.recover(input, grammar.getStartSymbol(), builder);
+    check(errors.size() == 2
+              && render(errors[0]) == "2: unexpected ), expected {(, x}\n"
+              && render(errors[1]) == "5: unexpected +, expected {(, x}\n",
+          "errors recover");
+    check(render(builder.getResult()) == exprTree, "errors recovered tree");
+
+    check(!parser.parse(lex("x +")).has_value(), "errors end of input");
+}
+
+static auto testMemory() -> void {
+    auto grammar = exprGrammar();
+    check(!LR1Parser::mk(grammar, 4096).has_value(), "memory build budget");
+    check(LR1Parser::mk(grammar, 0).has_value(), "memory build unlimited");
+
+    auto parser = LR1Parser::mk(grammar, 1 << 20);
+    check(parser.has_value(), "memory build");
+    if (!parser.has_value()) {
+        return;
+    }
+    auto before = parser.value().getUsage();
+    parser.value().release();
+    auto after = parser.value().getUsage();
+    check(after.total() < before.total() && after.table == before.table, "memory release");
+    check(after.analyses == 0, "memory release analyses");
+
+    auto input = lex("x * x + x $");
+    auto node  = parser.value().parse(input);
+    check(node.has_value() && cst::bytesOf(node.value()) > 0, "memory parse");
+    parser.value().setParseBudget(256);
+    node = parser.value().parse(input);
+    check(!node.has_value() && std::holds_alternative<memory::OverBudget>(node.error()), "memory parse budget");
+    parser.value().setParseBudget(0);
+
+    // renumbering only needs the table, regenerating it needs the item sets
+    auto profile = LR1Parser::TableT::Profile{};
+    parser.value().parse(input, &profile);
+    parser.value().renumber(profile);
+    check(render(parser.value().parse(input).value()) == exprTree, "memory renumber released");
+    auto threw = false;
+    try {
+        parser.value().genTable();
+    } catch (const std::logic_error &) {
+        threw = true;
+    }
+    check(threw, "memory genTable released");
+
+    // FIRST is only solved once a nonterminal follows the dot
+    auto pairs  = Grammar::mk(
+        "S"_sym,
+        Rule::mk("S"_sym).of("C"_sym, "C"_sym),
+        Rule::mk("C"_sym).of("c"_sym, "C"_sym),
+        Rule::mk("C"_sym).of("d"_sym));
+    auto solved = LR1Parser{pairs};
+    check(solved.getUsage().analyses > 0, "memory analyses");
+    solved.release();
+    check(solved.getUsage().analyses == 0, "memory analyses released");
 
-    auto node = parser.parse(std::vector<Symbol>{"x"_sym, "*"_sym, "x"_sym, "+"_sym, "x"_sym, "$"_sym});
-    std::cout << node;
+    // update starts over from the grammar
+    auto rule = Rule::mk("F"_sym).of("-"_sym, "F"_sym);
+    grammar.getRules().push_back(rule);
+    parser.value().update({rule}, {});
+    auto fresh = LR1Parser{grammar};
+    fresh.genTable();
+    check(fresh.getTable().diff(parser.value().getTable()).empty(), "memory update released");
 }
 
 auto main() -> int {
+    testFollow();
+    testLR1();
     testExpr();
-    return 0;
+    testGenerate();
+    testProfile();
+    testEntries();
+    testUpdate();
+    testBinary();
+    testLL1();
+    testAst();
+    testErrors();
+    testMemory();
+    return failures == 0 ? 0 : 1;
 }
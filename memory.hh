@@ -0,0 +1,90 @@
+#pragma once
+
+#include "grammar.hh"
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * Estimates of the bytes held by parser data structures
+ * * heapOf(x): bytes x owns on the heap, not counting sizeof(x)
+ * * mapNode/hashNode: one node of a std::map / std::unordered_* including
+ *   the allocator's view of its links, as laid out by libstdc++
+ * The numbers are estimates, good enough to compare structures and to
+ * enforce budgets, not to match the allocator byte for byte.
+ */
+namespace memory {
+
+template <typename T>
+constexpr size_t mapNode = 4 * sizeof(void *) + sizeof(T);
+template <typename T>
+constexpr size_t hashNode = 2 * sizeof(void *) + sizeof(T);
+
+static inline auto heapOf(const std::string &str) -> size_t {
+    // nothing is allocated while the string fits the inline buffer
+    return str.capacity() > std::string{}.capacity() ? str.capacity() + 1 : 0;
+}
+
+static inline auto heapOf(const Symbol &symbol) -> size_t {
+    return heapOf(symbol.getName());
+}
+
+static inline auto heapOf(const Rule &rule) -> size_t {
+    size_t result = heapOf(rule.getHead()) + rule.getBody().capacity() * sizeof(Symbol);
+    for (auto &&symbol : rule.getBody()) {
+        result += heapOf(symbol);
+    }
+    return result;
+}
+
+// what a parse sink holds, zero for sinks that do not keep track
+template <typename SinkT>
+static auto sinkBytes(const SinkT &sink) -> size_t {
+    if constexpr (requires { sink.getBytes(); }) {
+        return sink.getBytes();
+    } else {
+        return 0;
+    }
+}
+
+struct Usage {
+    auto total() const -> size_t { return itemSets + kernels + transitions + templates + analyses + table; }
+
+    size_t itemSets    = 0;
+    size_t kernels     = 0;
+    size_t transitions = 0;
+    size_t templates   = 0;
+    size_t analyses    = 0; // FIRST and nullable results
+    size_t table       = 0;
+};
+
+// a build or parse stopped because it would have used more than `budget`
+struct OverBudget {
+    size_t budget;
+    size_t used;
+};
+
+static inline auto operator<<(std::ostream &os, const Usage &usage) -> std::ostream & {
+    os << "item sets\t" << usage.itemSets << std::endl
+       << "kernels\t\t" << usage.kernels << std::endl
+       << "transitions\t" << usage.transitions << std::endl
+       << "templates\t" << usage.templates << std::endl
+       << "analyses\t" << usage.analyses << std::endl
+       << "table\t\t" << usage.table << std::endl
+       << "total\t\t" << usage.total() << std::endl;
+    return os;
+}
+
+static inline auto operator<<(std::ostream &os, const OverBudget &error) -> std::ostream & {
+    os << "over budget: "
+       << error.used
+       << " of "
+       << error.budget
+       << " bytes"
+       << std::endl;
+    return os;
+}
+
+}; // namespace memory
@@ -1,12 +1,21 @@
 #pragma once
 
 #include "grammar.hh"
+#include "memory.hh"
 
+#include <algorithm>
 #include <functional>
 #include <iostream>
+#include <limits>
 #include <map>
 #include <optional>
+#include <ranges>
+#include <set>
 #include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 template <typename StateT>
 class Table {
@@ -37,56 +46,303 @@ class Table {
         StateT              state;
     };
 
+    // one differing entry, gotos are reported as shifts on nonterminals
+    struct Change {
+        StateT                state;
+        Symbol                symbol;
+        std::optional<Action> before;
+        std::optional<Action> after;
+    };
+
+    // visit counts recorded by the parser, see LR1Parser::renumber
+    struct Profile {
+        std::vector<size_t>                         stateCount;
+        std::map<std::pair<StateT, StateT>, size_t> edgeCount;
+        std::map<Symbol, size_t>                    symbolCount;
+    };
+
+    // one dense entry, `value` is the target of a shift or the index of the
+    // reduced rule in getRule
+    struct Cell {
+        bool       set   = false;
+        ActionKind kind  = SHIFT;
+        StateT     value = 0;
+    };
+
     template <typename FuncT>
     Table(size_t         nState,
           const Grammar &grammar,
           FuncT          resolver) :
       nState_(nState),
       grammar_(grammar),
-      resolver_(resolver),
-      transitionTable_(nState),
-      actionTable_(nState) {
+      resolver_(resolver) {
+        for (auto &&symbol : grammar.getTerms()) {
+            termColumns_.emplace(symbol, terms_.size());
+            terms_.push_back(symbol);
+        }
+        for (auto &&symbol : grammar.getNTerms()) {
+            nTermColumns_.emplace(symbol, nTerms_.size());
+            nTerms_.push_back(symbol);
+        }
+        actionTable_.resize(nState_ * terms_.size());
+        transitionTable_.resize(nState_ * nTerms_.size(), none);
     }
 
-    auto getAction(StateT state, Symbol symbol) const -> std::optional<Action> {
-        auto &entry = actionTable_[state];
-        if (entry.contains(symbol)) {
-            return entry.at(symbol);
+    // the column of a terminal in every row, for lookups in a loop
+    auto getColumn(Symbol symbol) const -> std::optional<size_t> {
+        if (auto it = termColumns_.find(symbol); it != termColumns_.end()) {
+            return it->second;
         }
         return {};
     }
+    auto getCell(StateT state, size_t column) const -> const Cell & {
+        return actionTable_[state * terms_.size() + column];
+    }
+    auto getRule(size_t index) const -> const Rule & { return rules_[index]; }
+    // goto on the head of rule `index`, which must exist
+    auto getGoto(StateT state, size_t index) const -> StateT {
+        return transitionTable_[state * nTerms_.size() + ruleHeads_[index]];
+    }
+
+    auto getAction(StateT state, Symbol symbol) const -> std::optional<Action> {
+        auto column = getColumn(symbol);
+        if (!column.has_value()) {
+            return {};
+        }
+        return actionOf(getCell(state, column.value()));
+    }
     auto setAction(StateT state, Symbol symbol, Action action) -> void {
-        actionTable_[state][symbol] =
-            getAction(state, symbol)
-                .transform([this, action, symbol](auto &&x) {
-                    return resolver_(x, action, symbol);
-                })
-                .value_or(action);
+        auto column = addColumn(symbol);
+        action      = getAction(state, symbol)
+                     .transform([this, action, symbol](auto &&x) {
+                         return resolver_(x, action, symbol);
+                     })
+                     .value_or(action);
+
+        auto &cell = actionTable_[state * terms_.size() + column];
+        cell       = Cell{true, action.kind, action.state};
+        if (action.kind == REDUCE) {
+            cell.value = addRule(action.rule.value());
+        }
+    }
+    // terminals with an action in `state`, for error reporting
+    auto getExpected(StateT state) const -> std::set<Symbol> {
+        auto result = std::set<Symbol>{};
+        for (size_t column = 0; column < terms_.size(); column++) {
+            if (getCell(state, column).set) {
+                result.insert(terms_[column]);
+            }
+        }
+        return result;
     }
     auto getTransition(StateT from, Symbol symbol) const -> std::optional<StateT> {
-        auto &entry = transitionTable_[from];
-        if (entry.contains(symbol)) {
-            return entry.at(symbol);
+        auto it = nTermColumns_.find(symbol);
+        if (it == nTermColumns_.end() || transitionTable_[from * nTerms_.size() + it->second] == none) {
+            return {};
         }
-        return {};
+        return transitionTable_[from * nTerms_.size() + it->second];
     }
     auto setTransition(StateT from, Symbol symbol, StateT to) -> void {
-        transitionTable_[from][symbol] = to;
+        auto column = addColumn(symbol);
+        transitionTable_[from * nTerms_.size() + column] = to;
+    }
+    // drops the rows past nState, new rows start out empty
+    auto resize(size_t nState) -> void {
+        nState_ = nState;
+        actionTable_.resize(nState_ * terms_.size());
+        transitionTable_.resize(nState_ * nTerms_.size(), none);
     }
+    auto clearRow(StateT state) -> void {
+        std::fill_n(actionTable_.begin() + state * terms_.size(), terms_.size(), Cell{});
+        std::fill_n(transitionTable_.begin() + state * nTerms_.size(), nTerms_.size(), none);
+    }
+    // rows are stored one after another in state order, so the states
+    // placed first make up a dense hot prefix. order[new] = old, `columns`
+    // lists the terminals to put first, in that order
+    auto renumber(const std::vector<StateT> &order, const std::vector<Symbol> &columns) -> void;
+    auto diff(const Table &other) const -> std::vector<Change>;
     auto getStateCount() const -> size_t { return nState_; }
+    auto getBytes() const -> size_t;
     auto getGrammar() const -> const Grammar & { return grammar_; }
 
   private:
+    static constexpr StateT none = std::numeric_limits<StateT>::max();
+
+    auto actionOf(const Cell &cell) const -> std::optional<Action> {
+        if (!cell.set) {
+            return {};
+        }
+        switch (cell.kind) {
+            case SHIFT: return Action::mkShift(cell.value);
+            case REDUCE: return Action::mkReduce(rules_[cell.value]);
+            case ACCEPT: return Action::mkAccept();
+            default: std::abort();
+        }
+    }
+    // returns the column of `symbol`, widening every row if it is new
+    auto addColumn(Symbol symbol) -> size_t;
+    auto addRule(const Rule &rule) -> StateT;
+
     size_t         nState_;
     const Grammar &grammar_;
     std::function<Action(Action, Action, Symbol)>
         resolver_;
-    std::vector<std::map<Symbol, StateT>>
-        transitionTable_;
-    std::vector<std::map<Symbol, Action>>
-        actionTable_;
+
+    std::vector<Symbol>                               terms_;
+    std::vector<Symbol>                               nTerms_;
+    std::unordered_map<Symbol, size_t, Symbol::hash> termColumns_;
+    std::unordered_map<Symbol, size_t, Symbol::hash> nTermColumns_;
+    std::vector<Rule>                                 rules_;
+    std::vector<size_t>                               ruleHeads_;
+    std::map<Rule, StateT>                            ruleIndex_;
+    // nState_ rows of terms_.size() and nTerms_.size() entries
+    std::vector<Cell>   actionTable_;
+    std::vector<StateT> transitionTable_;
 };
 
+template <typename StateT>
+auto Table<StateT>::addColumn(Symbol symbol) -> size_t {
+    auto &&columns = symbol.isTerminal() ? termColumns_ : nTermColumns_;
+    if (auto it = columns.find(symbol); it != columns.end()) {
+        return it->second;
+    }
+
+    auto &&symbols = symbol.isTerminal() ? terms_ : nTerms_;
+    auto   width   = symbols.size();
+    columns.emplace(symbol, width);
+    symbols.push_back(symbol);
+    // only reached for symbols added to the grammar after construction
+    auto widen = [this, width](auto &table, auto fill) {
+        auto result = std::remove_cvref_t<decltype(table)>{};
+        result.reserve(nState_ * (width + 1));
+        for (size_t state = 0; state < nState_; state++) {
+            auto row = table.begin() + state * width;
+            result.insert(result.end(), row, row + width);
+            result.push_back(fill);
+        }
+        table = std::move(result);
+    };
+    if (symbol.isTerminal()) {
+        widen(actionTable_, Cell{});
+    } else {
+        widen(transitionTable_, none);
+    }
+    return width;
+}
+
+template <typename StateT>
+auto Table<StateT>::addRule(const Rule &rule) -> StateT {
+    if (auto it = ruleIndex_.find(rule); it != ruleIndex_.end()) {
+        return it->second;
+    }
+    auto index = rules_.size();
+    rules_.push_back(rule);
+    ruleHeads_.push_back(addColumn(rule.getHead()));
+    ruleIndex_.emplace(rule, index);
+    return index;
+}
+
+template <typename StateT>
+auto Table<StateT>::renumber(const std::vector<StateT> &order, const std::vector<Symbol> &columns) -> void {
+    // order[new] = old
+    auto index = std::vector<StateT>(nState_);
+    for (size_t i = 0; i < nState_; i++) {
+        index[order[i]] = i;
+    }
+
+    // terminals not listed keep their relative order after the listed ones
+    auto terms = std::vector<Symbol>{};
+    for (auto &&symbol : columns) {
+        if (termColumns_.contains(symbol) && std::ranges::find(terms, symbol) == terms.end()) {
+            terms.push_back(symbol);
+        }
+    }
+    for (auto &&symbol : terms_) {
+        if (std::ranges::find(terms, symbol) == terms.end()) {
+            terms.push_back(symbol);
+        }
+    }
+
+    auto width           = terms.size();
+    auto nWidth          = nTerms_.size();
+    auto actionTable     = std::vector<Cell>(nState_ * width);
+    auto transitionTable = std::vector<StateT>(nState_ * nWidth, none);
+    for (size_t i = 0; i < nState_; i++) {
+        for (size_t column = 0; column < width; column++) {
+            auto cell = getCell(order[i], termColumns_.at(terms[column]));
+            if (cell.set && cell.kind == SHIFT) {
+                cell.value = index[cell.value];
+            }
+            actionTable[i * width + column] = cell;
+        }
+        for (size_t column = 0; column < nWidth; column++) {
+            auto to = transitionTable_[order[i] * nWidth + column];
+            transitionTable[i * nWidth + column] = to == none ? none : index[to];
+        }
+    }
+    terms_ = std::move(terms);
+    for (size_t column = 0; column < width; column++) {
+        termColumns_.at(terms_[column]) = column;
+    }
+    actionTable_     = std::move(actionTable);
+    transitionTable_ = std::move(transitionTable);
+}
+
+template <typename StateT>
+auto Table<StateT>::getBytes() const -> size_t {
+    size_t result = actionTable_.capacity() * sizeof(Cell)
+                    + transitionTable_.capacity() * sizeof(StateT)
+                    + (terms_.capacity() + nTerms_.capacity()) * sizeof(Symbol)
+                    + (termColumns_.bucket_count() + nTermColumns_.bucket_count()) * sizeof(void *)
+                    + rules_.capacity() * sizeof(Rule)
+                    + ruleHeads_.capacity() * sizeof(size_t);
+    for (auto &&symbol : terms_) {
+        result += memory::hashNode<std::pair<const Symbol, size_t>> + 2 * memory::heapOf(symbol);
+    }
+    for (auto &&symbol : nTerms_) {
+        result += memory::hashNode<std::pair<const Symbol, size_t>> + 2 * memory::heapOf(symbol);
+    }
+    for (auto &&rule : rules_) {
+        result += memory::mapNode<std::pair<const Rule, StateT>> + 2 * memory::heapOf(rule);
+    }
+    return result;
+}
+
+template <typename StateT>
+auto Table<StateT>::diff(const Table &other) const -> std::vector<Change> {
+    auto entryOf = [](const Table &table, StateT state, Symbol symbol) -> std::optional<Action> {
+        if (state >= table.nState_) {
+            return {};
+        } else if (symbol.isTerminal()) {
+            return table.getAction(state, symbol);
+        }
+        return table.getTransition(state, symbol).transform(Action::mkShift);
+    };
+
+    auto result = std::vector<Change>{};
+    for (StateT state = 0; state < std::max(nState_, other.nState_); state++) {
+        auto symbols = std::set<Symbol>{};
+        for (auto &&table : {this, &other}) {
+            if (state < table->nState_) {
+                for (auto &&symbol : table->terms_) {
+                    symbols.insert(symbol);
+                }
+                for (auto &&symbol : table->nTerms_) {
+                    symbols.insert(symbol);
+                }
+            }
+        }
+        for (auto &&symbol : symbols) {
+            auto before = entryOf(*this, state, symbol);
+            auto after  = entryOf(other, state, symbol);
+            if (before != after) {
+                result.push_back(Change{state, symbol, before, after});
+            }
+        }
+    }
+    return result;
+}
+
 template <typename T>
 static auto operator<<(std::ostream &os, const Table<T> &table) -> std::ostream & {
     os << "\t: ";
@@ -6,6 +6,7 @@
 
 #include "utils.hh"
 #include "grammar.hh"
+#include "memory.hh"
 
 #include <cassert>
 #include <functional>
@@ -14,6 +15,7 @@
 #include <ranges>
 #include <map>
 #include <set>
+#include <utility>
 #include <vector>
 
 template <typename T>
@@ -25,6 +27,22 @@ static auto mergeInto(const std::set<T> &from, std::set<T> &to) -> bool {
     return changed;
 }
 
+template <typename K, typename V>
+static auto diffOf(const std::map<K, V> &before, const std::map<K, V> &after) -> std::set<K> {
+    std::set<K> result{};
+    for (auto &&[key, value] : after) {
+        if (!before.contains(key) || before.at(key) != value) {
+            result.insert(key);
+        }
+    }
+    for (auto &&[key, value] : before) {
+        if (!after.contains(key)) {
+            result.insert(key);
+        }
+    }
+    return result;
+}
+
 auto Nullable::nullable(std::vector<Symbol> body) -> bool {
     for (auto &&symbol : body) {
         if (!nullable(symbol)) {
@@ -40,22 +58,60 @@ auto Nullable::nullable(Symbol symbol) -> bool {
     }
 
     if (symbol.isEpsilon()) {
-        nullableMap.emplace(symbol, true);
         return true;
     } else if (symbol.isTerminal()) {
-        nullableMap.emplace(symbol, false);
         return false;
     }
+    solve();
+    return nullableMap.at(symbol);
+}
+
+auto Nullable::solve() -> void {
+    // fixpoint instead of recursion, left-recursive rules would never return
+    for (auto &&symbol : grammar.getSymbols()) {
+        nullableMap.emplace(symbol, symbol.isEpsilon());
+    }
 
-    for (auto &&rule : grammar.getRulesWith(symbol)) {
-        if (nullable(rule.getBody())) {
-            nullableMap.emplace(symbol, true);
-            return true;
+    bool changed;
+    do {
+        changed = false;
+        for (auto &&rule : grammar.getRules()) {
+            auto &&head = rule.getHead();
+            if (nullableMap.at(head)) {
+                continue;
+            }
+            bool result = true;
+            for (auto &&symbol : rule.getBody()) {
+                result &= nullableMap.at(symbol);
+            }
+            if (result) {
+                nullableMap.at(head) = true;
+                changed             = true;
+            }
         }
+    } while (changed);
+}
+
+auto Nullable::update() -> std::set<Symbol> {
+    // nothing was solved yet, so nothing can depend on the old results
+    if (nullableMap.empty()) {
+        return {};
     }
+    auto before = std::exchange(nullableMap, {});
+    solve();
+    return diffOf(before, nullableMap);
+}
 
-    nullableMap.emplace(symbol, false);
-    return false;
+auto Nullable::release() -> void {
+    std::exchange(nullableMap, {});
+}
+
+auto Nullable::getBytes() const -> size_t {
+    size_t result = 0;
+    for (auto &&symbol : nullableMap | std::views::keys) {
+        result += memory::mapNode<std::pair<const Symbol, bool>> + memory::heapOf(symbol);
+    }
+    return result;
 }
 
 auto First::getFirst(std::vector<Symbol> body) -> std::set<Symbol> {
@@ -108,6 +164,33 @@ auto First::solve() -> void {
     } while (changed);
 }
 
+auto First::update() -> std::set<Symbol> {
+    auto changed = nSolver.update();
+    if (firstMap.empty()) {
+        return changed;
+    }
+    auto before = std::exchange(firstMap, {});
+    solve();
+    mergeInto(diffOf(before, firstMap), changed);
+    return changed;
+}
+
+auto First::release() -> void {
+    std::exchange(firstMap, {});
+    nSolver.release();
+}
+
+auto First::getBytes() const -> size_t {
+    size_t result = nSolver.getBytes();
+    for (auto &&[symbol, first] : firstMap) {
+        result += memory::mapNode<std::pair<const Symbol, std::set<Symbol>>> + memory::heapOf(symbol);
+        for (auto &&x : first) {
+            result += memory::mapNode<Symbol> + memory::heapOf(x);
+        }
+    }
+    return result;
+}
+
 auto Follow::getFollow(Symbol symbol) -> std::set<Symbol> {
     if (followMap.count(symbol)) {
         return followMap.at(symbol);
@@ -120,7 +203,9 @@ auto Follow::solve() -> void {
     for (auto &&symbol : grammar.getSymbols()) {
         followMap.emplace(symbol, std::set<Symbol>{});
     }
-    followMap.at(grammar.getStartSymbol()).insert("$"_sym);
+    for (auto &&start : grammar.getStartSymbols()) {
+        followMap.at(start).insert("$"_sym);
+    }
 
     bool changed;
     do {
@@ -15,8 +15,15 @@ class Nullable {
 
     auto nullable(Symbol symbol) -> bool;
     auto nullable(std::vector<Symbol> body) -> bool;
+    // re-solves after the grammar changed, returns symbols whose result changed
+    auto update() -> std::set<Symbol>;
+    // drops the results, they are solved again when next asked for
+    auto release() -> void;
+    auto getBytes() const -> size_t;
 
   private:
+    auto solve() -> void;
+
     std::map<Symbol, bool> nullableMap;
     const Grammar         &grammar;
 };
@@ -30,16 +37,23 @@ class First {
 
     auto getFirst(Symbol symbol) -> std::set<Symbol>;
     auto getFirst(std::vector<Symbol> symbol) -> std::set<Symbol>;
+    auto nullable(Symbol symbol) -> bool { return nSolver.nullable(symbol); }
     auto getFirst(std::vector<Symbol> symbol, Symbol lookAhead) -> std::set<Symbol> {
         symbol.push_back(lookAhead);
         return getFirst(symbol);
     }
+    // re-solves after the grammar changed, returns symbols whose FIRST or
+    // nullable changed
+    auto update() -> std::set<Symbol>;
+    // as Nullable::release, the nullable results go too
+    auto release() -> void;
+    auto getBytes() const -> size_t;
 
   private:
     auto solve() -> void;
     auto ruleWith(Symbol head) -> std::vector<Rule> {
         auto view = (grammar.getRules()
-                     | std::views::filter([head](Rule rule) {
+                     | std::views::filter([head](const Rule &rule) {
                            return rule.getHead() == head;
                        }));
         return {view.begin(), view.end()};